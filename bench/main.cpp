@@ -0,0 +1,278 @@
+#include "log.cc/log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#ifdef _WIN32
+    #include <io.h>
+#endif
+
+
+// log.cc.bench [--records N] [--threads 1,2,4] [--loggers sync,async] [--sinks null,file,console]
+//              [--sizes 16,256] [--formatters default,pattern] [--queues mutex,lockfree,threadlocal]
+//              [--out bench.json]
+// Every combination is run; per call latency percentiles and throughput go to --out as
+// a JSON array, one object per run, and a summary table to stderr.
+// The console sink writes to fd 1, redirect it (> /dev/null) to measure the sink alone.
+
+using namespace logcc;
+using Clock = std::chrono::steady_clock;
+
+
+struct Options
+{
+    std::size_t              records    = 100000; // per producer thread
+    std::vector<int>         threads    = {1, 2, 4};
+    std::vector<std::string> loggers    = {"sync", "async"};
+    std::vector<std::string> sinks      = {"null", "file", "console"};
+    std::vector<int>         sizes      = {16, 256};
+    std::vector<std::string> formatters = {"default", "pattern"};
+    std::vector<std::string> queues     = {"mutex"};
+    std::string              out        = "bench.json";
+};
+
+struct Run
+{
+    std::string logger;
+    std::string sink;
+    std::string formatter;
+    std::string queue;
+    int         threads = 1;
+    int         size    = 0;
+};
+
+struct Result
+{
+    std::size_t   records         = 0;
+    double        producerSeconds = 0; // until every producer returned
+    double        totalSeconds    = 0; // until every record was written
+    std::uint64_t p50 = 0, p99 = 0, p999 = 0, max = 0; // ns per call
+};
+
+
+static std::vector<std::string> splitList(std::string_view str)
+{
+    std::vector<std::string> ret;
+    while (!str.empty()) {
+        std::size_t comma = str.find(',');
+        ret.emplace_back(str.substr(0, comma));
+        str = comma == std::string_view::npos ? std::string_view{} : str.substr(comma + 1);
+    }
+    return ret;
+}
+
+static std::vector<int> splitInts(std::string_view str)
+{
+    std::vector<int> ret;
+    for (const std::string &item : splitList(str)) {
+        ret.push_back(std::stoi(item));
+    }
+    return ret;
+}
+
+
+template <typename L>
+static void setFormatter(L &logger, std::string_view name)
+{
+    if (name == "pattern") {
+        logger.setFormatter(PatternFormatter<"[%l] %s:%# %v">{});
+    }
+    else if (name == "category") {
+        logger.setFormatter(CategoryFormatter{"bench"});
+    }
+    else {
+        logger.setFormatter(DefaultFormatter{});
+    }
+}
+
+// Runs `records` calls on each of `threads` producers, collecting every call's latency
+template <typename L>
+static void produce(L &logger, const Run &run, std::size_t records, const std::string &payload,
+                    std::vector<std::uint32_t> &latencies, double &seconds)
+{
+    std::vector<std::vector<std::uint32_t>> perThread(run.threads);
+    std::vector<std::thread>                producers;
+
+    auto start = Clock::now();
+    for (int t = 0; t < run.threads; ++t) {
+        producers.emplace_back([&, t]() {
+            std::vector<std::uint32_t> &samples = perThread[t];
+            samples.reserve(records);
+            for (std::size_t i = 0; i < records; ++i) {
+                auto before = Clock::now();
+                logger.info("{} {}", i, payload);
+                auto after = Clock::now();
+                samples.push_back((std::uint32_t)std::min<std::int64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count(), UINT32_MAX));
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (auto &samples : perThread) {
+        latencies.insert(latencies.end(), samples.begin(), samples.end());
+    }
+}
+
+static Result runOnce(const Run &run, std::size_t records)
+{
+    // every logger also writes to the console appender
+#ifdef _WIN32
+    static int nullFd = ::_open("NUL", _O_WRONLY);
+#else
+    static int nullFd = ::open("/dev/null", O_WRONLY);
+#endif
+    auto       silence = [&run](ConsoleAppender &console) {
+        if (run.sink != "console") {
+            console.setFds(nullFd, nullFd);
+        }
+    };
+
+    const std::string          payload(run.size, 'x');
+    const std::string          filename = "bench_" + run.logger + ".log";
+    std::vector<std::uint32_t> latencies;
+    Result                     result;
+    std::remove(filename.c_str());
+
+    auto start = Clock::now();
+    if (run.logger == "sync") {
+        SyncLogger logger;
+        silence(logger.consoleAppender);
+        setFormatter(logger, run.formatter);
+        if (run.sink == "file") {
+            logger.fileAppenders.emplace_back(filename);
+        }
+        produce(logger, run, records, payload, latencies, result.producerSeconds);
+        for (auto &fileAppender : logger.fileAppenders) {
+            fileAppender.flush();
+        }
+    }
+    else {
+        {
+            auto logCore = std::make_shared<AsyncLogControl>();
+            if (run.queue == "lockfree") {
+                logCore->useLockFreeQueue();
+            }
+            else if (run.queue == "threadlocal") {
+                logCore->useThreadLocalQueues();
+            }
+            if (run.sink == "file") {
+                logCore->addFileAppender(filename);
+            }
+            silence(logCore->consoleAppender);
+            logCore->run();
+
+            AsyncLogger logger(logCore);
+            setFormatter(logger, run.formatter);
+            produce(logger, run, records, payload, latencies, result.producerSeconds);
+        } // joins the worker: everything is written
+    }
+    result.totalSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::remove(filename.c_str());
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) -> std::uint64_t {
+        if (latencies.empty()) {
+            return 0;
+        }
+        return latencies[std::min(latencies.size() - 1, (std::size_t)(p * (double)latencies.size()))];
+    };
+    result.records = latencies.size();
+    result.p50     = percentile(0.50);
+    result.p99     = percentile(0.99);
+    result.p999    = percentile(0.999);
+    result.max     = latencies.empty() ? 0 : latencies.back();
+    return result;
+}
+
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view arg   = argv[i];
+        std::string_view value = argv[i + 1];
+        if (arg == "--records") options.records = std::stoul(std::string(value));
+        else if (arg == "--threads") options.threads = splitInts(value);
+        else if (arg == "--loggers") options.loggers = splitList(value);
+        else if (arg == "--sinks") options.sinks = splitList(value);
+        else if (arg == "--sizes") options.sizes = splitInts(value);
+        else if (arg == "--formatters") options.formatters = splitList(value);
+        else if (arg == "--queues") options.queues = splitList(value);
+        else if (arg == "--out") options.out = value;
+        else {
+            std::fprintf(stderr, "log.cc.bench: unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    std::ofstream json(options.out);
+    json << "[\n";
+    bool bFirst = true;
+
+    std::fprintf(stderr, "%-6s %-8s %-8s %-11s %3s %5s %12s %12s %8s %8s %8s %10s\n",
+                 "logger", "sink", "format", "queue", "thr", "size", "calls/s", "records/s", "p50", "p99", "p99.9", "max");
+    for (const std::string &logger : options.loggers) {
+        for (const std::string &sink : options.sinks) {
+            for (const std::string &formatter : options.formatters) {
+                for (const std::string &queue : options.queues) {
+                    if (logger == "sync" && queue != options.queues.front()) {
+                        continue; // no queue on the synchronous path
+                    }
+                    for (int threads : options.threads) {
+                        for (int size : options.sizes) {
+                            Run run{
+                                .logger    = logger,
+                                .sink      = sink,
+                                .formatter = formatter,
+                                .queue     = logger == "sync" ? "none" : queue,
+                                .threads   = threads,
+                                .size      = size,
+                            };
+                            Result result = runOnce(run, options.records);
+
+                            double callRate   = (double)result.records / result.producerSeconds;
+                            double recordRate = (double)result.records / result.totalSeconds;
+                            std::fprintf(stderr, "%-6s %-8s %-8s %-11s %3d %5d %12.0f %12.0f %8llu %8llu %8llu %10llu\n",
+                                         run.logger.c_str(), run.sink.c_str(), run.formatter.c_str(), run.queue.c_str(),
+                                         run.threads, run.size, callRate, recordRate,
+                                         (unsigned long long)result.p50, (unsigned long long)result.p99,
+                                         (unsigned long long)result.p999, (unsigned long long)result.max);
+
+                            json << (bFirst ? "  " : ",\n  ");
+                            bFirst = false;
+                            json << std::format("{{\"logger\": \"{}\", \"sink\": \"{}\", \"formatter\": \"{}\", \"queue\": \"{}\", "
+                                                "\"threads\": {}, \"size\": {}, \"records\": {}, "
+                                                "\"producer_seconds\": {:.6f}, \"total_seconds\": {:.6f}, "
+                                                "\"calls_per_second\": {:.0f}, \"records_per_second\": {:.0f}, "
+                                                "\"p50_ns\": {}, \"p99_ns\": {}, \"p999_ns\": {}, \"max_ns\": {}}}",
+                                                run.logger, run.sink, run.formatter, run.queue,
+                                                run.threads, run.size, result.records,
+                                                result.producerSeconds, result.totalSeconds,
+                                                callRate, recordRate,
+                                                result.p50, result.p99, result.p999, result.max);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    json << "\n]\n";
+    return 0;
+}
@@ -0,0 +1,453 @@
+#include "binary_log.h"
+
+#include <deque>
+#include <format>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+
+#include "log.h"
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+namespace BinaryLog
+{
+
+
+struct SiteKey
+{
+    const char   *fmt;
+    const char   *file;
+    std::uint32_t line;
+    std::uint32_t column;
+
+    bool operator==(const SiteKey &) const = default;
+};
+
+struct SiteKeyHash
+{
+    std::size_t operator()(const SiteKey &key) const
+    {
+        std::size_t h = std::hash<const void *>{}(key.fmt);
+        h ^= std::hash<const void *>{}(key.file) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        h ^= ((std::size_t)key.line << 16 | key.column) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+struct Registry
+{
+    std::mutex                                           mutex;
+    std::deque<CallSite>                                 sites; // id - 1, stable addresses
+    std::unordered_map<SiteKey, std::uint32_t, SiteKeyHash> ids;
+};
+
+static Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+
+std::uint32_t callSiteId(std::string_view fmt, const std::source_location &location)
+{
+    SiteKey key{fmt.data(), location.file_name(), location.line(), location.column()};
+
+    thread_local std::unordered_map<SiteKey, std::uint32_t, SiteKeyHash> cache;
+    if (auto it = cache.find(key); it != cache.end()) {
+        return it->second;
+    }
+
+    Registry                   &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto [it, bInserted] = reg.ids.try_emplace(key, (std::uint32_t)reg.sites.size() + 1);
+    if (bInserted) {
+        reg.sites.push_back(CallSite{
+            .id       = it->second,
+            .fmt      = std::string(fmt),
+            .file     = location.file_name(),
+            .function = location.function_name(),
+            .line     = location.line(),
+        });
+    }
+    cache.emplace(key, it->second);
+    return it->second;
+}
+
+const CallSite *callSite(std::uint32_t id)
+{
+    Registry                   &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (id == 0 || id > reg.sites.size()) {
+        return nullptr;
+    }
+    return &reg.sites[id - 1];
+}
+
+
+struct Arg
+{
+    EArg             type = EArg::Int;
+    std::int64_t     i    = 0;
+    std::uint64_t    u    = 0;
+    double           d    = 0;
+    float            f    = 0;
+    char             c    = 0;
+    std::string_view str;
+};
+
+static bool decodeArgs(std::string_view bytes, std::vector<Arg> &args)
+{
+    auto take = [&bytes](void *dst, std::size_t size) {
+        if (bytes.size() < size) {
+            return false;
+        }
+        std::memcpy(dst, bytes.data(), size);
+        bytes.remove_prefix(size);
+        return true;
+    };
+
+    while (!bytes.empty()) {
+        Arg arg;
+        if (!take(&arg.type, 1)) {
+            return false;
+        }
+        bool bOk = true;
+        switch (arg.type) {
+        case EArg::Bool:
+        {
+            std::uint8_t b = 0;
+            bOk            = take(&b, 1);
+            arg.u          = b;
+            break;
+        }
+        case EArg::Char:
+            bOk = take(&arg.c, 1);
+            break;
+        case EArg::Int:
+            bOk = take(&arg.i, 8);
+            break;
+        case EArg::UInt:
+        case EArg::Pointer:
+            bOk = take(&arg.u, 8);
+            break;
+        case EArg::Float:
+            bOk = take(&arg.f, 4);
+            break;
+        case EArg::Double:
+            bOk = take(&arg.d, 8);
+            break;
+        case EArg::String:
+        {
+            std::uint32_t size = 0;
+            bOk                = take(&size, 4) && bytes.size() >= size;
+            if (bOk) {
+                arg.str = bytes.substr(0, size);
+                bytes.remove_prefix(size);
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+        if (!bOk) {
+            return false;
+        }
+        args.push_back(arg);
+    }
+    return true;
+}
+
+static void formatArg(std::string &output, std::string_view spec, const Arg &arg)
+{
+    auto out = std::back_inserter(output);
+    try {
+        switch (arg.type) {
+        case EArg::Bool:
+        {
+            bool b = arg.u != 0;
+            std::vformat_to(out, spec, std::make_format_args(b));
+            break;
+        }
+        case EArg::Char:
+            std::vformat_to(out, spec, std::make_format_args(arg.c));
+            break;
+        case EArg::Int:
+            std::vformat_to(out, spec, std::make_format_args(arg.i));
+            break;
+        case EArg::UInt:
+            std::vformat_to(out, spec, std::make_format_args(arg.u));
+            break;
+        case EArg::Float:
+            std::vformat_to(out, spec, std::make_format_args(arg.f));
+            break;
+        case EArg::Double:
+            std::vformat_to(out, spec, std::make_format_args(arg.d));
+            break;
+        case EArg::String:
+            std::vformat_to(out, spec, std::make_format_args(arg.str));
+            break;
+        case EArg::Pointer:
+        {
+            const void *p = (const void *)(std::uintptr_t)arg.u;
+            std::vformat_to(out, spec, std::make_format_args(p));
+            break;
+        }
+        }
+    }
+    catch (const std::format_error &) {
+        output += spec;
+    }
+}
+
+void formatArgs(std::string &output, std::string_view fmt, std::string_view bytes)
+{
+    std::vector<Arg> args;
+    if (!decodeArgs(bytes, args)) {
+        output += "<corrupt arguments> ";
+        output += fmt;
+        return;
+    }
+
+    // walk the replacement fields and format each with its own spec
+    std::size_t autoIndex = 0;
+    std::string spec;
+    for (std::size_t i = 0; i < fmt.size(); ++i) {
+        char c = fmt[i];
+        if (c == '}') {
+            output += '}';
+            if (i + 1 < fmt.size() && fmt[i + 1] == '}') {
+                ++i;
+            }
+            continue;
+        }
+        if (c != '{') {
+            output += c;
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '{') {
+            output += '{';
+            ++i;
+            continue;
+        }
+
+        std::size_t close = fmt.find('}', i);
+        std::size_t open  = fmt.find('{', i + 1);
+        if (close == std::string_view::npos || open < close) {
+            // nested (dynamic) fields are not supported
+            output += fmt.substr(i);
+            return;
+        }
+        std::string_view field = fmt.substr(i + 1, close - i - 1);
+        std::size_t      colon = field.find(':');
+        std::string_view index = field.substr(0, colon);
+
+        std::size_t argIndex = autoIndex++;
+        if (!index.empty()) {
+            argIndex = 0;
+            for (char d : index) {
+                argIndex = argIndex * 10 + (std::size_t)(d - '0');
+            }
+        }
+
+        spec = "{";
+        if (colon != std::string_view::npos) {
+            spec += field.substr(colon);
+        }
+        spec += '}';
+        if (argIndex < args.size()) {
+            formatArg(output, spec, args[argIndex]);
+        }
+        else {
+            output += fmt.substr(i, close - i + 1);
+        }
+        i = close;
+    }
+}
+
+} // namespace BinaryLog
+
+
+BinaryFileAppender::BinaryFileAppender(std::string_view filename)
+    : filename(filename)
+{
+    streamBuffer = std::make_unique<char[]>(1 << 20);
+    fileStream.rdbuf()->pubsetbuf(streamBuffer.get(), 1 << 20);
+    fileStream.open(this->filename, std::ios::out | std::ios::app | std::ios::binary);
+
+    // every run starts a new session: call site ids are per process
+    frames.append(BinaryLog::Magic, sizeof(BinaryLog::Magic));
+    BinaryLog::put(frames, BinaryLog::Version);
+    BinaryLog::put(frames, BinaryLog::EndianCheck);
+    fileStream.write(frames.data(), (std::streamsize)frames.size());
+    frames.clear();
+}
+
+void BinaryFileAppender::write(std::span<const MessageElem> batch)
+{
+    using namespace BinaryLog;
+
+    frames.clear();
+    for (const MessageElem &elem : batch) {
+        std::int64_t wallNs = timestampFormatter.toWallNs(elem.timestamp);
+        if (elem.binarySite == 0) {
+            put(frames, EFrame::Text);
+            put(frames, (std::uint32_t)elem.level);
+            put(frames, wallNs);
+            putString(frames, elem.msg);
+            continue;
+        }
+
+        if (writtenSites.size() <= elem.binarySite) {
+            writtenSites.resize(elem.binarySite + 1);
+        }
+        if (!writtenSites[elem.binarySite]) {
+            writtenSites[elem.binarySite] = true;
+            const CallSite *site          = callSite(elem.binarySite);
+            put(frames, EFrame::CallSite);
+            put(frames, site->id);
+            put(frames, site->line);
+            putString(frames, site->fmt);
+            putString(frames, site->file);
+            putString(frames, site->function);
+        }
+
+        put(frames, EFrame::Record);
+        put(frames, elem.binarySite);
+        put(frames, (std::uint32_t)elem.level);
+        put(frames, wallNs);
+        putString(frames, elem.msg);
+    }
+    fileStream.write(frames.data(), (std::streamsize)frames.size());
+}
+
+void BinaryFileAppender::flush()
+{
+    fileStream.flush();
+}
+
+
+BinaryLogReader::BinaryLogReader(std::istream &in)
+    : in(in)
+{
+}
+
+bool BinaryLogReader::read(void *dst, std::size_t size)
+{
+    in.read((char *)dst, (std::streamsize)size);
+    return (std::size_t)in.gcount() == size;
+}
+
+bool BinaryLogReader::readString(std::string &str)
+{
+    std::uint32_t size = 0;
+    if (!read(&size, sizeof(size))) {
+        return false;
+    }
+    str.resize(size);
+    return read(str.data(), size);
+}
+
+bool BinaryLogReader::readSession()
+{
+    char          magic[sizeof(BinaryLog::Magic) - 1];
+    std::uint32_t version = 0, endian = 0;
+    // the first magic byte was consumed as the frame type
+    if (!read(magic, sizeof(magic)) || std::memcmp(magic, BinaryLog::Magic + 1, sizeof(magic)) != 0 ||
+        !read(&version, 4) || !read(&endian, 4))
+    {
+        errorMsg = "bad session header";
+        return false;
+    }
+    if (version != BinaryLog::Version || endian != BinaryLog::EndianCheck) {
+        errorMsg = std::format("unsupported version {} / byte order {:#x}", version, endian);
+        return false;
+    }
+    sites.clear();
+    return true;
+}
+
+bool BinaryLogReader::next(Record &record)
+{
+    using namespace BinaryLog;
+
+    for (;;) {
+        char type = 0;
+        if (!read(&type, 1)) {
+            return false; // end of input
+        }
+
+        if (type == Magic[0]) {
+            if (!readSession()) {
+                return false;
+            }
+            continue;
+        }
+
+        switch ((EFrame)type) {
+        case EFrame::CallSite:
+        {
+            CallSite site;
+            if (!read(&site.id, 4) || !read(&site.line, 4) ||
+                !readString(site.fmt) || !readString(site.file) || !readString(site.function))
+            {
+                errorMsg = "truncated call site frame";
+                return false;
+            }
+            // ids start at 1 and are handed out densely, see callSiteId()
+            if (site.id == 0 || site.id > MaxSiteId) {
+                errorMsg = std::format("bad call site id {}", site.id);
+                return false;
+            }
+            if (sites.size() <= site.id) {
+                sites.resize(site.id + 1);
+            }
+            sites[site.id] = std::move(site);
+            continue;
+        }
+        case EFrame::Record:
+        {
+            std::uint32_t siteId = 0, level = 0;
+            if (!read(&siteId, 4) || !read(&level, 4) || !read(&record.wallNs, 8) || !readString(args)) {
+                errorMsg = "truncated record frame";
+                return false;
+            }
+            if (siteId == 0 || siteId >= sites.size() || sites[siteId].id != siteId) {
+                errorMsg = std::format("record refers to unknown call site {}", siteId);
+                return false;
+            }
+            if (!LogLevel::isValid(level)) {
+                errorMsg = std::format("record with bad level {}", level);
+                return false;
+            }
+            record.level = (LogLevel::T)level;
+            record.site  = &sites[siteId];
+            record.text.clear();
+            formatArgs(record.text, record.site->fmt, args);
+            return true;
+        }
+        case EFrame::Text:
+        {
+            std::uint32_t level = 0;
+            if (!read(&level, 4) || !read(&record.wallNs, 8) || !readString(record.text)) {
+                errorMsg = "truncated text frame";
+                return false;
+            }
+            if (!LogLevel::isValid(level)) {
+                errorMsg = std::format("text record with bad level {}", level);
+                return false;
+            }
+            record.level = (LogLevel::T)level;
+            record.site  = nullptr;
+            return true;
+        }
+        default:
+            errorMsg = std::format("unknown frame type {}", (int)type);
+            return false;
+        }
+    }
+}
+
+
+TOP_LEVEL_NAMESPACE_END
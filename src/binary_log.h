@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <source_location>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "base.h"
+#include "log_level.h"
+#include "timestamp.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+struct MessageElem;
+
+
+// Binary log: a call site's format string and location are written once per file,
+// each record is then only  site id + level + timestamp + raw argument bytes.
+// `log.cc.decode` turns such a file back into text.
+//
+// File layout (host byte order), a file may hold several sessions back to back:
+//   session : "LOGCCBIN" u32 version u32 0x01020304 frame*
+//   frame   : u8 EFrame, then
+//     CallSite: u32 id, u32 line, str fmt, str file, str function
+//     Record  : u32 site id, u32 level, i64 wall ns, str argument bytes
+//     Text    : u32 level, i64 wall ns, str text (records formatted on the caller)
+//   str     : u32 size, bytes
+namespace BinaryLog
+{
+
+inline constexpr char          Magic[8]    = {'L', 'O', 'G', 'C', 'C', 'B', 'I', 'N'};
+inline constexpr std::uint32_t Version     = 1;
+inline constexpr std::uint32_t EndianCheck = 0x01020304;
+inline constexpr std::uint32_t MaxSiteId   = 1 << 24; // a reader refuses larger ids as corrupt
+
+enum class EFrame : std::uint8_t
+{
+    CallSite = 1,
+    Record   = 2,
+    Text     = 3,
+};
+
+enum class EArg : std::uint8_t
+{
+    Bool = 1,
+    Char,
+    Int,    // any signed integer, as i64
+    UInt,   // any unsigned integer, as u64
+    Float,
+    Double,
+    String, // u32 size, bytes
+    Pointer,
+};
+
+struct CallSite
+{
+    std::uint32_t id = 0;
+    std::string   fmt;
+    std::string   file;
+    std::string   function;
+    std::uint32_t line = 0;
+};
+
+
+template <typename T>
+inline void put(std::string &out, const T &value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+inline void putString(std::string &out, std::string_view str)
+{
+    put(out, (std::uint32_t)str.size());
+    out.append(str);
+}
+
+template <typename T>
+inline void encodeArg(std::string &out, const T &value)
+{
+    using D = std::remove_cvref_t<T>;
+    if constexpr (std::is_same_v<D, bool>) {
+        put(out, EArg::Bool);
+        put(out, (std::uint8_t)value);
+    }
+    else if constexpr (std::is_same_v<D, char>) {
+        put(out, EArg::Char);
+        put(out, value);
+    }
+    else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>) {
+        put(out, EArg::Int);
+        put(out, (std::int64_t)value);
+    }
+    else if constexpr (std::is_integral_v<D>) {
+        put(out, EArg::UInt);
+        put(out, (std::uint64_t)value);
+    }
+    else if constexpr (std::is_same_v<D, float>) {
+        put(out, EArg::Float);
+        put(out, value);
+    }
+    else if constexpr (std::is_same_v<D, double>) {
+        put(out, EArg::Double);
+        put(out, value);
+    }
+    else if constexpr (std::is_same_v<D, const char *> || std::is_same_v<D, char *>) {
+        put(out, EArg::String);
+        putString(out, value ? std::string_view(value) : std::string_view("(null)"));
+    }
+    else if constexpr (std::is_convertible_v<const D &, std::string_view>) {
+        put(out, EArg::String);
+        putString(out, std::string_view(value));
+    }
+    else if constexpr (std::is_pointer_v<D> || std::is_null_pointer_v<D>) {
+        put(out, EArg::Pointer);
+        put(out, (std::uint64_t)(std::uintptr_t)(const void *)value);
+    }
+    else {
+        static_assert(std::is_void_v<D>, "log.cc: binary logging supports arithmetic, string and pointer arguments only");
+    }
+}
+
+template <typename... Args>
+inline void encodeArgs(std::string &out, const Args &...args)
+{
+    (encodeArg(out, args), ...);
+}
+
+// Id of the call site (fmt, location), registering it on first use.
+// Cached per thread, so only a thread's first record from a site takes the registry lock.
+extern LOG_CC_API std::uint32_t callSiteId(std::string_view fmt, const std::source_location &location);
+// nullptr for unknown ids; the returned site lives until the process exits
+extern LOG_CC_API const CallSite *callSite(std::uint32_t id);
+
+// Formats the encoded `args` with `fmt` (std::format syntax) and appends the result.
+// Dynamic width/precision ("{:{}}") is not supported and rendered as-is.
+extern LOG_CC_API void formatArgs(std::string &output, std::string_view fmt, std::string_view args);
+
+} // namespace BinaryLog
+
+
+// Writes queued records in the binary format above; used by AsyncLogControl::useBinaryFile()
+struct LOG_CC_API BinaryFileAppender
+{
+    BinaryFileAppender(std::string_view filename);
+
+    BinaryFileAppender(const BinaryFileAppender &)            = delete;
+    BinaryFileAppender &operator=(const BinaryFileAppender &) = delete;
+
+    void write(std::span<const MessageElem> batch);
+    void flush();
+
+    std::string filename;
+
+  private:
+    std::ofstream           fileStream;
+    std::unique_ptr<char[]> streamBuffer;
+    std::string             frames;
+    std::vector<bool>       writtenSites; // indexed by site id
+    TimestampFormatter      timestampFormatter;
+};
+
+
+// Reads a binary log back, one record at a time
+struct LOG_CC_API BinaryLogReader
+{
+    struct Record
+    {
+        LogLevel::T                level  = LogLevel::Info;
+        std::int64_t               wallNs = 0;
+        const BinaryLog::CallSite *site   = nullptr; // nullptr for text records
+        std::string                text;             // formatted message, or the whole text record
+    };
+
+    BinaryLogReader(std::istream &in);
+
+    // false at the end of input or on a corrupt frame (see error())
+    bool next(Record &record);
+
+    const std::string &error() const { return errorMsg; }
+
+  private:
+    bool readSession();
+    bool read(void *dst, std::size_t size);
+    bool readString(std::string &str);
+
+    std::istream                    &in;
+    std::vector<BinaryLog::CallSite> sites; // of the current session, indexed by id
+    std::string                      args;
+    std::string                      errorMsg;
+};
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <source_location>
+#include <string_view>
+#include <type_traits>
+
+#include "base.h"
+#include "log_level.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+// "src/a/b.cpp" -> "b.cpp"
+constexpr std::string_view baseName(std::string_view path)
+{
+    std::size_t pos = path.find_last_of("/\\");
+    return pos == std::string_view::npos ? path : path.substr(pos + 1);
+}
+
+// Everything about a logging statement that is known at compile time, one static
+// instance per statement (see LOG_CC_INFO() & co); only its address is passed around.
+struct CallSiteMeta
+{
+    // level names the macros can reach through the logger's type
+    static constexpr LogLevel::T Debug = LogLevel::Debug;
+    static constexpr LogLevel::T Trace = LogLevel::Trace;
+    static constexpr LogLevel::T Info  = LogLevel::Info;
+    static constexpr LogLevel::T Warn  = LogLevel::Warn;
+    static constexpr LogLevel::T Error = LogLevel::Error;
+    static constexpr LogLevel::T Fatal = LogLevel::Fatal;
+
+    LogLevel::T          level;
+    std::string_view     fmt;
+    std::string_view     file; // basename
+    std::uint32_t        line;
+    std::source_location location;
+
+    consteval CallSiteMeta(LogLevel::T level, std::string_view fmt, std::source_location location = std::source_location::current())
+        : level(level), fmt(fmt), file(baseName(location.file_name())), line(location.line()), location(location)
+    {
+    }
+};
+
+
+TOP_LEVEL_NAMESPACE_END
+
+
+// LOG_CC_INFO(logger, "x={} y={}", x, y);
+// The format string is still checked at compile time; the level, basename, line and
+// format string live in a static CallSiteMeta. Works with every logger that has logSite().
+// The namespace is only reached through the logger's type, so this keeps working after
+// macro_end.h.
+#define LOG_CC_LOG(logger, level, fmt, ...)                                                  \
+    do {                                                                                     \
+        using logcc_site_t = typename std::remove_cvref_t<decltype(logger)>::call_site_t;    \
+        static constexpr logcc_site_t logcc_site(logcc_site_t::level, fmt);                  \
+        (logger).logSite(logcc_site, fmt __VA_OPT__(, ) __VA_ARGS__);                         \
+    } while (0)
+
+#define LOG_CC_DEBUG(logger, fmt, ...) LOG_CC_LOG(logger, Debug, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_CC_TRACE(logger, fmt, ...) LOG_CC_LOG(logger, Trace, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_CC_INFO(logger, fmt, ...)  LOG_CC_LOG(logger, Info, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_CC_WARN(logger, fmt, ...)  LOG_CC_LOG(logger, Warn, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_CC_ERROR(logger, fmt, ...) LOG_CC_LOG(logger, Error, fmt __VA_OPT__(, ) __VA_ARGS__)
+#define LOG_CC_FATAL(logger, fmt, ...) LOG_CC_LOG(logger, Fatal, fmt __VA_OPT__(, ) __VA_ARGS__)
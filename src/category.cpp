@@ -0,0 +1,212 @@
+#include "category.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "log.h"
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+CategoryRegistry &CategoryRegistry::instance()
+{
+    // leaked on purpose: a global logger may still read its category during static destruction
+    static CategoryRegistry *registry = new CategoryRegistry;
+    return *registry;
+}
+
+CategoryRegistry::CategoryRegistry()
+{
+    if (const char *spec = std::getenv(EnvVar)) {
+        if (!configure(spec)) {
+            debug("log.cc::CategoryRegistry"), "invalid", EnvVar, spec;
+        }
+    }
+}
+
+CategoryRegistry::~CategoryRegistry()
+{
+    stopWatching();
+}
+
+Category &CategoryRegistry::get(std::string_view name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto                        it = byName.find(std::string(name));
+    if (it != byName.end()) {
+        return *it->second;
+    }
+    Category &category = categories.emplace_back(name, defaultLevel);
+    byName.emplace(category.name, &category);
+    apply(category);
+    return category;
+}
+
+void CategoryRegistry::setLevel(std::string_view name, LogLevel::T level)
+{
+    Category                   &category = get(name);
+    std::lock_guard<std::mutex> lock(mutex);
+    pinned[category.name] = level;
+    apply(category);
+}
+
+void CategoryRegistry::setDefaultLevel(LogLevel::T level)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    defaultLevel = level;
+    applyAll();
+}
+
+void CategoryRegistry::apply(Category &category)
+{
+    LogLevel::T level = fileDefaultLevel.value_or(defaultLevel);
+    if (auto it = pinned.find(category.name); it != pinned.end()) {
+        level = it->second;
+    }
+    else if (auto it = fromFile.find(category.name); it != fromFile.end()) {
+        level = it->second;
+    }
+    else if (auto it = configured.find(category.name); it != configured.end()) {
+        level = it->second;
+    }
+    category.level.store(level, std::memory_order_relaxed);
+}
+
+void CategoryRegistry::applyAll()
+{
+    for (Category &category : categories) {
+        apply(category);
+    }
+}
+
+std::optional<LogLevel::T> CategoryRegistry::parseLevel(std::string_view str)
+{
+    std::string lower;
+    for (char c : str) {
+        lower.push_back((char)std::tolower((unsigned char)c));
+    }
+    constexpr std::string_view names[LogLevel::Count] = {"debug", "trace", "info", "warn", "error", "fatal"};
+    for (std::size_t i = 0; i < LogLevel::Count; ++i) {
+        if (lower == names[i]) {
+            return (LogLevel::T)((i + 1) * 100);
+        }
+    }
+    if (lower == "off") {
+        return Off;
+    }
+    return std::nullopt;
+}
+
+static std::string_view trim(std::string_view str)
+{
+    while (!str.empty() && std::isspace((unsigned char)str.front())) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && std::isspace((unsigned char)str.back())) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+bool CategoryRegistry::parse(std::string_view spec, levels_t &levels, std::optional<LogLevel::T> &defaultLevel)
+{
+    bool bOk = true;
+    while (!spec.empty()) {
+        std::size_t      end   = spec.find_first_of(",;\n");
+        std::string_view entry = spec.substr(0, end);
+        spec                   = end == std::string_view::npos ? std::string_view{} : spec.substr(end + 1);
+
+        entry = trim(entry.substr(0, entry.find('#')));
+        if (entry.empty()) {
+            continue;
+        }
+        std::size_t                eq    = entry.find('=');
+        std::optional<LogLevel::T> level = eq == std::string_view::npos ? std::nullopt : parseLevel(trim(entry.substr(eq + 1)));
+        std::string_view           name  = eq == std::string_view::npos ? std::string_view{} : trim(entry.substr(0, eq));
+        if (!level || name.empty()) {
+            bOk = false;
+            continue;
+        }
+        if (name == "*") {
+            defaultLevel = *level;
+        }
+        else {
+            levels[std::string(name)] = *level;
+        }
+    }
+    return bOk;
+}
+
+bool CategoryRegistry::configure(std::string_view spec, bool bReplace)
+{
+    levels_t                   levels;
+    std::optional<LogLevel::T> level;
+    bool                       bOk = parse(spec, levels, level);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (bReplace) {
+        configured.clear();
+    }
+    levels.merge(configured); // keeps the new value of a category in both
+    configured.swap(levels);
+    if (level) {
+        defaultLevel = *level;
+    }
+    applyAll();
+    return bOk;
+}
+
+void CategoryRegistry::watchFile(const std::filesystem::path &path, std::chrono::milliseconds interval)
+{
+    stopWatching();
+    bStopWatch = false;
+    watcher    = std::thread([this, path, interval]() { watchLoop(path, interval); });
+}
+
+void CategoryRegistry::stopWatching()
+{
+    {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        bStopWatch = true;
+        watchCv.notify_all();
+    }
+    if (watcher.joinable()) {
+        watcher.join();
+    }
+}
+
+void CategoryRegistry::watchLoop(std::filesystem::path path, std::chrono::milliseconds interval)
+{
+    std::optional<std::filesystem::file_time_type> lastWrite;
+    for (;;) {
+        std::error_code ec;
+        auto            writeTime = std::filesystem::last_write_time(path, ec);
+        if (!ec && writeTime != lastWrite) {
+            lastWrite = writeTime;
+            std::ifstream     in(path);
+            std::stringstream content;
+            content << in.rdbuf();
+
+            levels_t                   levels;
+            std::optional<LogLevel::T> level;
+            if (!parse(content.str(), levels, level)) {
+                debug("log.cc::CategoryRegistry"), "invalid entries in", path.string();
+            }
+            std::lock_guard<std::mutex> registryLock(mutex);
+            fromFile.swap(levels);
+            fileDefaultLevel = level;
+            applyAll();
+        }
+
+        std::unique_lock<std::mutex> lock(watchMutex);
+        if (watchCv.wait_for(lock, interval, [this]() { return bStopWatch; })) {
+            return;
+        }
+    }
+}
+
+
+TOP_LEVEL_NAMESPACE_END
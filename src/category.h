@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "base.h"
+#include "log_level.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+// A named subsystem whose level can be changed while the program runs,
+// see LoggerBase::setCategory()
+struct Category
+{
+    std::string              name;
+    std::atomic<LogLevel::T> level;
+
+    Category(std::string_view name, LogLevel::T level)
+        : name(name), level(level)
+    {
+    }
+
+    // the whole fast path: one relaxed load
+    bool bEnabled(LogLevel::T recordLevel) const
+    {
+        return recordLevel >= level.load(std::memory_order_relaxed);
+    }
+};
+
+
+// Process wide registry of categories. Levels come from, in order of precedence:
+// setLevel(), then the watched file, then a "name=level" spec given to configure() /
+// the LOG_CC_LEVELS environment variable, then the default level ("*=level"; the
+// file's, if it has one, over configure()'s).
+//   LOG_CC_LEVELS="*=info,net=debug,db=warn"
+// The registry is never destroyed, so categories outlive every logger, also those
+// logging during static destruction.
+struct LOG_CC_API CategoryRegistry
+{
+    static constexpr const char *EnvVar = "LOG_CC_LEVELS";
+    // level above Fatal: nothing is logged
+    static constexpr LogLevel::T Off = (LogLevel::T)(LogLevel::Fatal + 100);
+
+    static CategoryRegistry &instance();
+
+    ~CategoryRegistry();
+
+    CategoryRegistry(const CategoryRegistry &)            = delete;
+    CategoryRegistry &operator=(const CategoryRegistry &) = delete;
+
+    // Created on first use and kept until the process exits: loggers keep the reference
+    Category &get(std::string_view name);
+
+    void setLevel(std::string_view name, LogLevel::T level);
+    void setDefaultLevel(LogLevel::T level);
+
+    // Applies "name=level" assignments separated by ',', ';' or new lines ('#' starts a comment).
+    // With `bReplace`, categories the spec does not mention go back to the default level.
+    // Returns false if any assignment could not be parsed (the valid ones still apply).
+    bool configure(std::string_view spec, bool bReplace = false);
+
+    // Re-reads `path` whenever its modification time changes. Each read replaces what the
+    // previous one set, so a line removed from the file (the "*=level" one too) hands the
+    // category back to setLevel() / configure() / LOG_CC_LEVELS.
+    void watchFile(const std::filesystem::path &path, std::chrono::milliseconds interval = std::chrono::seconds(1));
+    void stopWatching();
+
+    // "debug" .. "fatal", "off"; case insensitive
+    static std::optional<LogLevel::T> parseLevel(std::string_view str);
+
+  private:
+    CategoryRegistry();
+
+    using levels_t = std::unordered_map<std::string, LogLevel::T>;
+
+    // Parses `spec` into `levels` and `defaultLevel` ("*"); false if any assignment is invalid
+    static bool parse(std::string_view spec, levels_t &levels, std::optional<LogLevel::T> &defaultLevel);
+
+    void apply(Category &category); // mutex held
+    void applyAll();                // mutex held
+    void watchLoop(std::filesystem::path path, std::chrono::milliseconds interval);
+
+    std::mutex                                  mutex;
+    std::deque<Category>                        categories; // stable addresses
+    std::unordered_map<std::string, Category *> byName;
+    levels_t                                    configured; // from configure()
+    levels_t                                    pinned;     // from setLevel()
+    LogLevel::T                                 defaultLevel = LogLevel::Debug;
+    // the last read of the watched file
+    levels_t                   fromFile;
+    std::optional<LogLevel::T> fileDefaultLevel;
+
+    std::thread             watcher;
+    std::mutex              watchMutex;
+    std::condition_variable watchCv;
+    bool                    bStopWatch = false;
+};
+
+
+TOP_LEVEL_NAMESPACE_END
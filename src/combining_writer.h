@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "base.h"
+#include "ring_queue.h"
+#include "worker_thread.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+// Flat combining: a thread publishes its request in a slot, then either finds it already
+// processed or takes the lock and processes every request published so far in one go.
+// Under contention one thread does the writing for all of them while the others wait on
+// their own cache line, instead of each taking the lock in turn. A waiter spins briefly,
+// then sleeps on its slot (std::atomic::wait) until the combiner has written its request.
+template <typename T>
+struct CombiningWriter
+{
+    static constexpr std::size_t SlotCount = 64;
+    static constexpr int         SpinCount = 64; // polls before a waiter sleeps
+
+    CombiningWriter() = default;
+
+    CombiningWriter(const CombiningWriter &)            = delete;
+    CombiningWriter &operator=(const CombiningWriter &) = delete;
+
+    // Calls `combine(std::span<T *const>)` on `request` and whatever else is pending, on this
+    // or another thread; returns once `request` has been processed.
+    // `combine` only ever runs on one thread at a time.
+    template <typename F>
+    void submit(T &request, F &&combine)
+    {
+        Slot &slot     = slots[slotIndex()];
+        T    *expected = nullptr;
+        if (!slot.request.compare_exchange_strong(expected, &request, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            // another thread sharing this slot is mid-request
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                combineLocked(&request, combine);
+            }
+            combineStragglers(combine);
+            return;
+        }
+
+        for (int spin = 0; spin < SpinCount; ++spin) {
+            if (slot.request.load(std::memory_order_acquire) != &request) {
+                return; // a combiner processed it
+            }
+            if (mutex.try_lock()) {
+                if (slot.request.load(std::memory_order_acquire) == &request) {
+                    combineLocked(nullptr, combine);
+                }
+                mutex.unlock();
+                combineStragglers(combine);
+                return;
+            }
+            cpuRelax();
+        }
+
+        while (slot.request.load(std::memory_order_seq_cst) == &request) {
+            if (bCombining.load(std::memory_order_seq_cst)) {
+                // that combiner either takes this slot or finds it in combineStragglers(),
+                // and notifies it once written
+                slot.request.wait(&request, std::memory_order_acquire);
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (slot.request.load(std::memory_order_acquire) == &request) {
+                    combineLocked(nullptr, combine);
+                }
+            }
+            combineStragglers(combine);
+            return;
+        }
+    }
+
+  private:
+    struct alignas(CacheLineSize) Slot
+    {
+        std::atomic<T *> request{nullptr};
+    };
+
+    // mutex held
+    template <typename F>
+    void combineLocked(T *own, F &combine)
+    {
+        bCombining.store(true, std::memory_order_seq_cst);
+        pending.clear();
+        taken.clear();
+        if (own) {
+            pending.push_back(own);
+        }
+        for (std::size_t i = 0; i < SlotCount; ++i) {
+            collect(i);
+        }
+        combine(std::span<T *const>(pending));
+        release();
+        bCombining.store(false, std::memory_order_seq_cst);
+    }
+
+    // mutex released: a request published while combineLocked() ran may have gone to sleep
+    // seeing bCombining set. Such a slot was published before bCombining was cleared, so it
+    // is in the snapshot taken here; one pass over the snapshot, without setting bCombining,
+    // leaves no new sleeper behind. Later requests see bCombining clear and lock themselves.
+    template <typename F>
+    void combineStragglers(F &combine)
+    {
+        std::size_t occupied[SlotCount];
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < SlotCount; ++i) {
+            if (slots[i].request.load(std::memory_order_seq_cst) != nullptr) {
+                occupied[count++] = i;
+            }
+        }
+        if (count == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.clear();
+        taken.clear();
+        for (std::size_t i = 0; i < count; ++i) {
+            collect(occupied[i]); // may have been taken by another combiner meanwhile
+        }
+        if (!pending.empty()) {
+            combine(std::span<T *const>(pending));
+            release();
+        }
+    }
+
+    // mutex held
+    void collect(std::size_t i)
+    {
+        if (T *request = slots[i].request.load(std::memory_order_acquire)) {
+            pending.push_back(request);
+            taken.push_back(i);
+        }
+    }
+
+    // mutex held: only the slots collected, others may have been published since
+    void release()
+    {
+        for (std::size_t i : taken) {
+            slots[i].request.store(nullptr, std::memory_order_release);
+            slots[i].request.notify_one();
+        }
+    }
+
+    static std::size_t slotIndex()
+    {
+        static std::atomic<std::size_t> counter{0};
+        thread_local std::size_t        index = counter.fetch_add(1, std::memory_order_relaxed) % SlotCount;
+        return index;
+    }
+
+    Slot slots[SlotCount];
+
+    std::mutex               mutex;
+    std::atomic<bool>        bCombining{false}; // inside combineLocked()
+    std::vector<T *>         pending;           // mutex held
+    std::vector<std::size_t> taken;             // mutex held
+};
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <format>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <source_location>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "base.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+// A compile-time checked format string plus the call site, so variadic
+// logging functions can still default their std::source_location.
+template <typename... Args>
+struct FormatLocation
+{
+    std::format_string<Args...> fmt;
+    std::string_view            str; // basic_format_string::get() is not in every C++20 library yet
+    std::source_location        location;
+
+    template <typename S>
+        requires std::convertible_to<const S &, std::string_view>
+    consteval FormatLocation(const S &fmt, std::source_location location = std::source_location::current())
+        : fmt(fmt), str(fmt), location(location)
+    {
+    }
+};
+
+
+// How an argument is kept until the worker formats it:
+// views and C strings are copied into an owning std::string, the rest by value.
+template <typename T>
+struct DeferredCapture
+{
+    using type = std::decay_t<T>;
+};
+template <>
+struct DeferredCapture<const char *>
+{
+    using type = std::string;
+};
+template <>
+struct DeferredCapture<char *>
+{
+    using type = std::string;
+};
+template <>
+struct DeferredCapture<std::string_view>
+{
+    using type = std::string;
+};
+
+template <typename T>
+using deferred_capture_t = typename DeferredCapture<std::decay_t<T>>::type;
+
+// A null C string is captured as "(null)" rather than handed to std::string
+template <typename T>
+decltype(auto) deferredCaptureArg(T &&arg)
+{
+    if constexpr (std::is_same_v<std::decay_t<T>, const char *> || std::is_same_v<std::decay_t<T>, char *>) {
+        const char *str = arg;
+        return str ? std::string(str) : std::string("(null)");
+    }
+    else {
+        return std::forward<T>(arg);
+    }
+}
+
+
+// Move-only, type-erased copy of the arguments of one log call.
+// Small argument packs live inline (no allocation), bigger ones on the heap.
+struct DeferredArgs
+{
+    static constexpr std::size_t InlineSize = 64;
+
+    DeferredArgs() = default;
+
+    template <typename... Args>
+    static DeferredArgs capture(Args &&...args)
+    {
+        using tuple_t = std::tuple<deferred_capture_t<Args>...>;
+
+        DeferredArgs ret;
+        if constexpr (sizeof(tuple_t) <= InlineSize && alignof(tuple_t) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible_v<tuple_t>)
+        {
+            ::new (ret.storage) tuple_t(deferredCaptureArg(std::forward<Args>(args))...);
+            ret.ops = &OpsFor<tuple_t>::inlineOps;
+        }
+        else {
+            ret.heap = new tuple_t(deferredCaptureArg(std::forward<Args>(args))...);
+            ret.ops  = &OpsFor<tuple_t>::heapOps;
+        }
+        return ret;
+    }
+
+    DeferredArgs(DeferredArgs &&other) noexcept
+    {
+        steal(other);
+    }
+
+    DeferredArgs &operator=(DeferredArgs &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            steal(other);
+        }
+        return *this;
+    }
+
+    DeferredArgs(const DeferredArgs &)            = delete;
+    DeferredArgs &operator=(const DeferredArgs &) = delete;
+
+    ~DeferredArgs()
+    {
+        reset();
+    }
+
+    explicit operator bool() const { return ops != nullptr; }
+
+    // Appends std::vformat(fmt, args...) to output
+    void formatTo(std::string &output, std::string_view fmt) const
+    {
+        ops->format(ops->bInline ? (const void *)storage : heap, fmt, output);
+    }
+
+    // Bytes allocated outside this object: the pack when it lives on the heap, plus the
+    // text of captured strings too long for their small-string buffer
+    std::size_t heapBytes() const
+    {
+        return ops ? ops->heapBytes(ops->bInline ? (const void *)storage : heap) : 0;
+    }
+
+    void reset()
+    {
+        if (ops) {
+            ops->destroy(ops->bInline ? (void *)storage : heap);
+            ops  = nullptr;
+            heap = nullptr;
+        }
+    }
+
+  private:
+    struct Ops
+    {
+        void (*format)(const void *args, std::string_view fmt, std::string &output);
+        void (*relocate)(void *dst, void *src) noexcept; // inline only: move into dst, destroy src
+        void (*destroy)(void *args) noexcept;
+        std::size_t (*heapBytes)(const void *args) noexcept;
+        bool bInline;
+    };
+
+    template <typename T>
+    static std::size_t stringHeapBytes(const T &value) noexcept
+    {
+        if constexpr (std::is_same_v<T, std::string>) {
+            const char *self = (const char *)&value;
+            bool bLocal = std::greater_equal<const char *>()(value.data(), self) && std::less<const char *>()(value.data(), self + sizeof(value));
+            return bLocal ? 0 : value.capacity() + 1;
+        }
+        else {
+            return 0;
+        }
+    }
+
+    template <typename Tuple>
+    struct OpsFor
+    {
+        static void format(const void *args, std::string_view fmt, std::string &output)
+        {
+            std::apply(
+                [&](const auto &...values) {
+                    std::vformat_to(std::back_inserter(output), fmt, std::make_format_args(values...));
+                },
+                *static_cast<const Tuple *>(args));
+        }
+        static void relocate(void *dst, void *src) noexcept
+        {
+            ::new (dst) Tuple(std::move(*static_cast<Tuple *>(src)));
+            static_cast<Tuple *>(src)->~Tuple();
+        }
+        static void destroyInline(void *args) noexcept
+        {
+            static_cast<Tuple *>(args)->~Tuple();
+        }
+        static void destroyHeap(void *args) noexcept
+        {
+            delete static_cast<Tuple *>(args);
+        }
+        template <bool bInline>
+        static std::size_t heapBytes(const void *args) noexcept
+        {
+            std::size_t ret = bInline ? 0 : sizeof(Tuple);
+            std::apply(
+                [&ret](const auto &...values) {
+                    ((ret += stringHeapBytes(values)), ...);
+                },
+                *static_cast<const Tuple *>(args));
+            return ret;
+        }
+
+        static constexpr Ops inlineOps{&format, &relocate, &destroyInline, &heapBytes<true>, true};
+        static constexpr Ops heapOps{&format, nullptr, &destroyHeap, &heapBytes<false>, false};
+    };
+
+    void steal(DeferredArgs &other) noexcept
+    {
+        ops = other.ops;
+        if (ops && ops->bInline) {
+            ops->relocate(storage, other.storage);
+        }
+        else {
+            heap = other.heap;
+        }
+        other.ops  = nullptr;
+        other.heap = nullptr;
+    }
+
+    const Ops *ops  = nullptr;
+    void      *heap = nullptr;
+    alignas(std::max_align_t) unsigned char storage[InlineSize];
+};
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -2,8 +2,21 @@
 
 #pragma once
 
+#include "../../binary_log.h"
+#include "../../call_site.h"
+#include "../../category.h"
+#include "../../combining_writer.h"
 #include "../../log.h"
+#include "../../log_filter.h"
 #include "../../log_level.h"
+#include "../../log_stats.h"
+#include "../../mmap_file_appender.h"
+#include "../../raw_file_appender.h"
+#include "../../rotating_file_appender.h"
+#include "../../static_logger.h"
+#include "../../structured_log.h"
+#include "../../uring_file_appender.h"
+#include "../../worker_thread.h"
 
 
 
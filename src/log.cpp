@@ -2,8 +2,16 @@
 #include <cassert>
 #include <ctime>
 #include <format>
+#include <iterator>
 #include <unordered_map>
 
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <cerrno>
+    #include <unistd.h>
+#endif
+
 #include "log.h"
 
 
@@ -34,6 +42,89 @@ std::string getCurentTimeStr()
 #endif
 }
 
+std::string &threadLocalBuffer()
+{
+    thread_local std::string buffer;
+    return buffer;
+}
+
+static bool bTerminal(int fd)
+{
+#ifdef _WIN32
+    return ::_isatty(fd) != 0;
+#else
+    return ::isatty(fd) != 0;
+#endif
+}
+
+ConsoleAppender::ConsoleAppender(LogLevel::T stderrLevel)
+    : out{.fd = 1, .bColor = bTerminal(1)},
+      err{.fd = 2, .bColor = bTerminal(2)},
+      stderrLevel(stderrLevel)
+{
+}
+
+void ConsoleAppender::setColor(bool bColor)
+{
+    out.bColor = bColor;
+    err.bColor = bColor;
+}
+
+void ConsoleAppender::setFds(int outFd, int errFd)
+{
+    out.fd = outFd;
+    err.fd = errFd;
+}
+
+void ConsoleAppender::operator()(const MessageElem &elem)
+{
+    Stream &stream = elem.level >= stderrLevel ? err : out;
+    append(stream, elem);
+    writeAll(stream);
+}
+
+void ConsoleAppender::write(std::span<const MessageElem> batch)
+{
+    for (const MessageElem &elem : batch) {
+        append(elem.level >= stderrLevel ? err : out, elem);
+    }
+    writeAll(out);
+    writeAll(err);
+}
+
+void ConsoleAppender::append(Stream &stream, const MessageElem &elem)
+{
+    if (!stream.bColor) {
+        stream.buffer += elem.msg;
+        return;
+    }
+    stream.buffer += LogLevel::levelTerminalColorCodes[LogLevel::toIndex(elem.level)];
+    stream.buffer += elem.msg;
+    stream.buffer += LogLevel::resetTerminalColorCode;
+}
+
+void ConsoleAppender::writeAll(Stream &stream)
+{
+    const char *data = stream.buffer.data();
+    std::size_t size = stream.buffer.size();
+    while (size > 0) {
+#ifdef _WIN32
+        int n = ::_write(stream.fd, data, (unsigned int)size);
+#else
+        ssize_t n = ::write(stream.fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (n <= 0) {
+            break; // closed pipe or the like: the console is best effort
+        }
+        data += n;
+        size -= (std::size_t)n;
+    }
+    stream.buffer.clear();
+}
+
 void Config::setLogLevel(LogLevel::T level)
 {
     logLevel = level;
@@ -46,64 +137,96 @@ void Config::setLogDetailLevel(LogLevel::T level)
 
 
 
+bool LoggerBase::admit(LogLevel::T level, const std::source_location &location)
+{
+    std::uint64_t suppressed = 0;
+    if (!rateLimiter.allow(location, suppressed)) {
+        return false;
+    }
+    if (suppressed > 0) {
+        std::string output;
+        const Field fields[] = {{"suppressed", suppressed}};
+        if (formatFields(formatter, fieldEncoder, config, output, level, "records suppressed by the rate limit", fields, location)) {
+            emit(level, output);
+        }
+    }
+    return true;
+}
+
+
+
 bool DefaultFormatter::operator()(const Config &config, std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location)
 {
+    output.clear();
+    appendPrefix(config, output, level, location);
+    output += msg;
+    output += '\n';
 
-    std::string_view levelStr = LogLevel::level2Strings.find(level)->second;
+    return true;
+}
+
+void DefaultFormatter::appendPrefix(const Config &config, std::string &output, LogLevel::T level, const std::source_location &location) const
+{
+    appendPrefix(config, output, level, location.file_name(), location.line());
+}
+
+void DefaultFormatter::appendPrefix(const Config &config, std::string &output, LogLevel::T level, std::string_view file, std::uint_least32_t line) const
+{
+    std::string_view levelStr = LogLevel::levelStrings[LogLevel::toIndex(level)];
     // clang-format off
     if (level >= config.logDetailLevel) {
         // TODO: custom format, let user define a macro?
-        output = std::format(
+        std::format_to(std::back_inserter(output),
             "[{}]\t"
-                "{}:{} "
-                "{}\n",
+                "{}:{} ",
                 levelStr,
-                location.file_name(), location.line(),
-                msg);
-
+                file, line);
     }
     else {
         // [error] : what msg
-        output = std::format(
-            "[{}]\t"
-                "{}"
-                "\n",
-                levelStr,
-                msg);
+        std::format_to(std::back_inserter(output),
+            "[{}]\t",
+                levelStr);
     }
     // clang-format on
-
-    return true;
 }
 
 
 
 bool CategoryFormatter::operator()(const Config &config, std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location)
 {
-    std::string_view levelStr = LogLevel::toString(level);
+    output.clear();
+    appendPrefix(config, output, level, location);
+    output += msg;
+    output += '\n';
 
+    return true;
+}
+
+void CategoryFormatter::appendPrefix(const Config &config, std::string &output, LogLevel::T level, const std::source_location &location) const
+{
+    appendPrefix(config, output, level, location.file_name(), location.line());
+}
+
+void CategoryFormatter::appendPrefix(const Config &config, std::string &output, LogLevel::T level, std::string_view file, std::uint_least32_t line) const
+{
+    std::string_view levelStr = LogLevel::toString(level);
 
     // clang-format off
     if (level >= config.logDetailLevel) {
-        output = std::format(
+        std::format_to(std::back_inserter(output),
             "[{}]\t{} "
-                "{}:{} "
-                "{}\n",
+                "{}:{} ",
                 levelStr, category,
-                location.file_name(), location.line(),
-                msg);
+                file, line);
     }
     else {
         // (color)LogRender [error] : what msg(reset color)\n
-        output = std::format(
-            "[{}]\t{} "
-                "{}\n",
-                levelStr, category,
-                msg);
+        std::format_to(std::back_inserter(output),
+            "[{}]\t{} ",
+                levelStr, category);
     }
     // clang-format on
-
-    return true;
 }
 
 
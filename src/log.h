@@ -2,25 +2,44 @@
 
 // #include "level.h"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <source_location>
+#include <span>
 #include <thread>
 
 #include <format>
 #include <fstream>
+#include <iterator>
 #include <unordered_map>
 #include <vector>
 
 
 
 #include "base.h"
+#include "binary_log.h"
+#include "call_site.h"
+#include "category.h"
+#include "combining_writer.h"
+#include "deferred_args.h"
+#include "log_filter.h"
 #include "log_level.h"
+#include "log_stats.h"
+#include "pattern_formatter.h"
+#include "ring_queue.h"
+#include "structured_log.h"
+#include "timestamp.h"
+#include "worker_thread.h"
 
 
 
@@ -28,6 +47,8 @@ TOP_LEVEL_NAMESPACE_BEGIN
 
 
 extern std::string LOG_CC_API getCurentTimeStr();
+// Per-thread scratch string reused by the typed logging members
+extern LOG_CC_API std::string &threadLocalBuffer();
 // #define LOG_CC_PROFILE_ENABLE
 
 
@@ -37,40 +58,112 @@ struct LOG_CC_API Config
     LogLevel::T logLevel       = LogLevel::Debug;
     LogLevel::T logDetailLevel = LogLevel::Warn; // With source location
 
+    // as logDetailLevel: no record gets a source location
+    static constexpr LogLevel::T NoDetail = (LogLevel::T)(LogLevel::Fatal + 100);
+
     void setLogLevel(LogLevel::T level);
     void setLogDetailLevel(LogLevel::T level);
 };
 
 
-struct MessageElem
+using FormatterFunc = std::function<bool(const Config &config, std::string &output, LogLevel::T, std::string_view, const std::source_location &)>;
+// a formatter's appendPrefix(config, output, level, file, line), for CallSiteMeta records
+using SitePrefixFunc = std::function<void(const Config &config, std::string &output, LogLevel::T, std::string_view file, std::uint_least32_t line)>;
+// a FieldEncoder's encode(), see LoggerBase::setFormatter()
+using FieldEncoderFunc = std::function<void(const Config &config, std::string &output, LogLevel::T, std::string_view msg,
+                                            std::span<const Field>, const std::source_location &)>;
+
+// `msg` and `fields` as one record: through `fieldEncoder` when set, otherwise through
+// `formatter` with the fields appended to the message as " key=value" pairs
+inline bool formatFields(const FormatterFunc &formatter, const FieldEncoderFunc &fieldEncoder, const Config &config, std::string &output,
+                         LogLevel::T level, std::string_view msg, std::span<const Field> fields, const std::source_location &location)
+{
+    if (fieldEncoder) {
+        output.clear();
+        fieldEncoder(config, output, level, msg, fields, location);
+        return true;
+    }
+    std::string text(msg);
+    appendLogfmtFields(text, fields);
+    return formatter(config, output, level, text, location);
+}
+
+
+// Everything needed to produce a record's text later, on the worker thread
+struct DeferredMessage
 {
-    LogLevel::T level;
-    std::string msg;
+    std::string_view                     fmt;
+    std::source_location                 location;
+    Config                               config;
+    std::shared_ptr<const FormatterFunc> formatter;
+    DeferredArgs                         args;
+    // set for CallSiteMeta records whose formatter can render a prefix on its own
+    std::shared_ptr<const SitePrefixFunc> sitePrefix;
+
+    explicit operator bool() const { return (bool)args; }
+
+    // `timestamp` is the record's, for formatters that print the time (PatternFormatter's %T)
+    void render(LogLevel::T level, std::int64_t timestamp, std::string &output) const
+    {
+        RecordTimeScope scope(timestamp);
+        std::string     msg;
+        args.formatTo(msg, fmt);
+        (*formatter)(config, output, level, msg, location);
+    }
 };
 
-struct ConsoleAppender
+struct MessageElem
 {
-    std::ostream &out = std::cout;
+    LogLevel::T         level;
+    std::string         msg;
+    DeferredMessage     deferred;             // set for AsyncLogger::logDeferred(), msg is filled by the worker
+    std::int64_t        timestamp  = 0;       // timestampNow() on the producer, orders merged per-thread queues
+    std::uint32_t       binarySite = 0;       // AsyncLogger::logBinary(): BinaryLog call site id, msg holds the encoded arguments
+    const CallSiteMeta *site       = nullptr; // AsyncLogger::logSite(), with `deferred`
+};
 
-    ConsoleAppender() = default;
+// Writes to the stdout / stderr file descriptors directly, bypassing std::cout.
+// Each call goes out in one write(); color codes are only added when the descriptor
+// was a terminal at construction.
+struct LOG_CC_API ConsoleAppender
+{
+    // stderrLevel that keeps every record on stdout
+    static constexpr LogLevel::T NoStderr = (LogLevel::T)(LogLevel::Fatal + 100);
 
-    void operator()(const MessageElem &elem)
+    ConsoleAppender()
+        : ConsoleAppender(NoStderr)
     {
-        static const std::string_view resetColor = LogLevel::color2TerminalColorCode.find(LogLevel::ETerminalColor::Reset)->second;
-        const std::string_view        color      = LogLevel::level2TerminalColorCode.find(elem.level)->second;
-        out.write(color.data(), color.size());
-        out.write(elem.msg.data(), elem.msg.size());
-        out.write(resetColor.data(), resetColor.size());
     }
+    // records at or above `stderrLevel` go to stderr
+    explicit ConsoleAppender(LogLevel::T stderrLevel);
 
-    void operator<<(const MessageElem &elem)
+    // overrides the isatty() check, for both streams
+    void setColor(bool bColor);
+    // e.g. /dev/null for benchmarks; the color choice is kept
+    void setFds(int outFd, int errFd);
+
+    void operator()(const MessageElem &elem);
+    void operator<<(const MessageElem &elem) { (*this)(elem); }
+
+    // One write per stream for the whole batch
+    void write(std::span<const MessageElem> batch);
+
+    void flush() {} // nothing is buffered
+
+  private:
+    struct Stream
     {
-        static const std::string_view resetColor = LogLevel::color2TerminalColorCode.find(LogLevel::ETerminalColor::Reset)->second;
-        const std::string_view        color      = LogLevel::level2TerminalColorCode.find(elem.level)->second;
-        out.write(color.data(), color.size());
-        out.write(elem.msg.data(), elem.msg.size());
-        out.write(resetColor.data(), resetColor.size());
-    }
+        int         fd;
+        bool        bColor;
+        std::string buffer;
+    };
+
+    static void append(Stream &stream, const MessageElem &elem);
+    static void writeAll(Stream &stream);
+
+    Stream      out;
+    Stream      err;
+    LogLevel::T stderrLevel;
 };
 
 struct FileAppender
@@ -124,13 +217,38 @@ struct FileAppender
     {
         fileStream << elem.msg;
     }
+
+    // A batch larger than the stream buffer bypasses it: one write syscall
+    void write(std::span<const MessageElem> batch)
+    {
+        batchBuffer.clear();
+        for (const MessageElem &elem : batch) {
+            batchBuffer += elem.msg;
+        }
+        fileStream.write(batchBuffer.data(), (std::streamsize)batchBuffer.size());
+    }
+
+  private:
+    std::string batchBuffer;
 };
 
 
 
+// A formatter may also expose
+//   void appendPrefix(const Config &, std::string &output, LogLevel::T, const std::source_location &) const
+// which appends everything that goes before the message (the record ends with '\n').
+// The typed members (logger.info("x={}", x)) then format header and message into one buffer.
+template <typename F>
+concept PrefixFormatter = requires(const F &f, const Config &config, std::string &output, LogLevel::T level, const std::source_location &location) {
+    f.appendPrefix(config, output, level, location);
+};
+
 struct LOG_CC_API DefaultFormatter
 {
     bool operator()(const Config &config, std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location);
+    void appendPrefix(const Config &config, std::string &output, LogLevel::T level, const std::source_location &location) const;
+    // same, for locations that are not a std::source_location (e.g. decoded from a binary log)
+    void appendPrefix(const Config &config, std::string &output, LogLevel::T level, std::string_view file, std::uint_least32_t line) const;
 };
 
 struct LOG_CC_API CategoryFormatter
@@ -138,233 +256,1665 @@ struct LOG_CC_API CategoryFormatter
     std::string category;
 
     bool operator()(const Config &config, std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location);
+    void appendPrefix(const Config &config, std::string &output, LogLevel::T level, const std::source_location &location) const;
+    void appendPrefix(const Config &config, std::string &output, LogLevel::T level, std::string_view file, std::uint_least32_t line) const;
 };
 
 //----------------------
 #pragma region Async Log
 
 
-struct MessageQueue
+// Text bytes of a batch, for the sink stats
+inline std::size_t byteCount(std::span<const MessageElem> batch)
 {
+    std::size_t ret = 0;
+    for (const MessageElem &elem : batch) {
+        ret += elem.msg.size();
+    }
+    return ret;
+}
 
 
-    std::queue<MessageElem> queue;
-    std::mutex              mutex;
-    std::condition_variable cv;
-    bool                    bShutdown = false;
+// Appenders added with AsyncLogControl::addAppender(), driven by the worker thread
+struct AsyncAppender
+{
+    virtual ~AsyncAppender() = default;
+
+    virtual void write(std::span<const MessageElem> batch) = 0;
+    virtual void flush()                                   = 0;
+    // called at least every AsyncLogControl::pollInterval, for time based work
+    virtual void poll() {}
+    // for AsyncLogControl::stats()
+    virtual std::string name() const { return "appender"; }
+};
 
-  public:
+// Wraps any appender with write(span) and flush(), poll() is optional
+template <typename T>
+struct AsyncAppenderOf : public AsyncAppender
+{
+    T appender;
 
-    void push(MessageElem &&elem)
+    template <typename... Args>
+    AsyncAppenderOf(Args &&...args)
+        : appender(std::forward<Args>(args)...)
     {
-        std::lock_guard<std::mutex> lock(mutex);
-        queue.emplace(std::move(elem));
-        cv.notify_one();
     }
 
-    bool pop(MessageElem &elem)
+    void write(std::span<const MessageElem> batch) override
     {
-        std::unique_lock<std::mutex> lock(mutex); // this will lock automatically! double lock cause a error
-        cv.wait(lock, [this]() {
-            // printf("queue size: %zu, bShutdown: %d", queue.size(), bShutdown);
-            return !queue.empty() || bShutdown;
-        });
-        if (bShutdown && queue.empty()) {
-            return false;
+        appender.write(batch);
+    }
+
+    void flush() override
+    {
+        appender.flush();
+    }
+
+    void poll() override
+    {
+        if constexpr (requires { appender.poll(); }) {
+            appender.poll();
         }
+    }
 
-        // why? save it to file
-        while (bShutdown && !queue.empty()) {
-            elem = queue.front();
-            queue.pop();
-            return false;
+    std::string name() const override
+    {
+        if constexpr (requires { appender.filename; }) {
+            return appender.filename;
         }
+        return AsyncAppender::name();
+    }
+};
 
-        elem = std::move(queue.front());
-        queue.pop();
-        return true;
+
+// Drives an appender owned elsewhere (AsyncLogControl::fileAppenders / consoleAppender)
+// from a SinkWorker, flushing it every `flushInterval`
+template <typename T>
+struct AsyncAppenderRef : public AsyncAppender
+{
+    T                                    &appender;
+    std::chrono::seconds                  flushInterval;
+    std::chrono::steady_clock::time_point lastFlush = std::chrono::steady_clock::now();
+    SinkCounters                         &counters; // the periodic flushes
+
+    AsyncAppenderRef(T &appender, std::chrono::seconds flushInterval, SinkCounters &counters)
+        : appender(appender), flushInterval(flushInterval), counters(counters)
+    {
     }
 
+    void write(std::span<const MessageElem> batch) override
+    {
+        appender.write(batch);
+    }
 
-    void shutdown()
+    void flush() override
     {
-        std::lock_guard<std::mutex> lock(mutex);
-        bShutdown = true;
-        cv.notify_all();
+        appender.flush();
+    }
+
+    void poll() override
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastFlush >= flushInterval) {
+            appender.flush();
+            counters.addFlush(elapsedNs(now));
+            lastFlush = now;
+        }
     }
 };
 
-struct AsyncLogControl
+
+// Runs one appender on its own thread, see AsyncLogControl::useSinkThreads().
+// Every sink is handed the same immutable batch, so records are shared rather than
+// copied per sink, and a slow sink only falls behind by itself.
+struct SinkWorker
 {
-    AsyncLogControl()                                    = default;
-    AsyncLogControl(const AsyncLogControl &)                     = delete;
-    AsyncLogControl(AsyncLogControl &&)                          = delete;
-    AsyncLogControl          &operator=(const AsyncLogControl &) = delete;
-    AsyncLogControl          &operator=(AsyncLogControl &&)      = delete;
-    std::vector<FileAppender> fileAppenders;
-    ConsoleAppender           consoleAppender;
+    using batch_t = std::shared_ptr<const std::vector<MessageElem>>;
 
-    std::thread  workerThread;
-    MessageQueue msgQueue;
+    SinkWorker(AsyncAppender &appender, SinkCounters &counters, std::chrono::milliseconds pollInterval, std::size_t maxPending)
+        : appender(appender), counters(counters), pollInterval(pollInterval), maxPending(maxPending)
+    {
+        workerThread = std::thread([this]() { loop(); });
+    }
 
+    SinkWorker(const SinkWorker &)            = delete;
+    SinkWorker &operator=(const SinkWorker &) = delete;
 
-    ~AsyncLogControl()
+    ~SinkWorker()
     {
-        msgQueue.shutdown();
+        shutdown();
         if (workerThread.joinable()) {
             workerThread.join();
         }
     }
 
-    void run()
+    // Blocks only while `maxPending` batches are already waiting for this sink
+    void push(batch_t batch)
     {
-        // std::format("{}", 123);
-        static constexpr int flushIntervalSec = 10;
-
-        auto flushTask = [this]() {
-            static auto last = std::chrono::system_clock::now();
-            std::size_t gap  = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - last).count();
-            if (gap >= flushIntervalSec) {
-                for (auto &fileAppender : fileAppenders) {
-                    fileAppender.flush();
-                    debug("log.cc::AsyncLogControl"),
-                        (std::format(" {} log thread flushed {} , gap: {}\n", getCurentTimeStr(), fileAppender.filename, gap));
-                }
-                last = std::chrono::system_clock::now();
-            }
-        };
-
+        std::unique_lock<std::mutex> lock(mutex);
+        spaceCv.wait(lock, [this]() {
+            return pending.size() < maxPending;
+        });
+        pending.push_back(std::move(batch));
+        cv.notify_one();
+    }
 
-        workerThread = std::thread([this, flushTask]() {
-            static MessageElem elem;
-            while (msgQueue.pop(elem)) {
-                // internalLog(std::format("pop msg:{} \n", elem.msg.c_str()));
-                for (auto &fileAppender : fileAppenders) {
-                    fileAppender(elem);
-                }
+    // Flushes the appender once the batches pushed so far are written
+    void requestFlush()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bFlushRequested = true;
+        cv.notify_one();
+    }
 
-                consoleAppender(elem);
+    // Writes what is pending, flushes the appender and stops the thread
+    void shutdown()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bShutdown = true;
+        cv.notify_one();
+    }
 
-                flushTask();
+  private:
+    void loop()
+    {
+        std::deque<batch_t> work;
+        for (;;) {
+            bool bStop, bFlush;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait_for(lock, pollInterval, [this]() {
+                    return !pending.empty() || bFlushRequested || bShutdown;
+                });
+                work.swap(pending);
+                bStop           = bShutdown;
+                bFlush          = bFlushRequested;
+                bFlushRequested = false;
             }
-        });
+            if (!work.empty()) {
+                spaceCv.notify_all();
+            }
+            for (const batch_t &batch : work) {
+                auto start = std::chrono::steady_clock::now();
+                appender.write(*batch);
+                counters.addWrite(batch->size(), byteCount(*batch), elapsedNs(start));
+            }
+            work.clear();
+            if (bFlush && !bStop) {
+                auto start = std::chrono::steady_clock::now();
+                appender.flush();
+                counters.addFlush(elapsedNs(start));
+            }
+            appender.poll();
+            if (bStop) {
+                break;
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        appender.flush();
+        counters.addFlush(elapsedNs(start));
     }
 
-    void push(std::string &&msg, LogLevel::T level = LogLevel::Info)
+    AsyncAppender            &appender;
+    SinkCounters             &counters;
+    std::chrono::milliseconds pollInterval;
+    std::size_t               maxPending;
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::condition_variable spaceCv;
+    std::deque<batch_t>     pending;
+    bool                    bShutdown       = false;
+    bool                    bFlushRequested = false;
+    std::thread             workerThread;
+};
+
+
+// What a full queue does with one more record, see AsyncLogControl::setQueueLimit()
+enum class EOverflowPolicy
+{
+    Block,          // the producer waits for room
+    DropNewest,     // the incoming record is discarded
+    DropOldest,     // the oldest queued record is discarded to make room
+    DropBelowLevel, // records below QueueLimit::dropBelow are discarded, the rest block
+};
+
+struct QueueLimit
+{
+    std::size_t     capacity  = 0; // records; 0 = unbounded
+    EOverflowPolicy policy    = EOverflowPolicy::Block;
+    LogLevel::T     dropBelow = LogLevel::Warn; // for DropBelowLevel
+};
+
+// Records lost to an overflow policy, per level
+struct DropCounters
+{
+    std::array<std::atomic<std::uint64_t>, LogLevel::Count> perLevel{};
+
+    void count(LogLevel::T level)
     {
-        msgQueue.push({
-            .level = level,
-            .msg   = std::move(msg),
-        });
+        perLevel[LogLevel::toIndex(level)].fetch_add(1, std::memory_order_relaxed);
     }
 
-    void addFileAppender(std::string_view filename)
+    std::uint64_t total() const
     {
-        // auto ap = FileAppender(filename);
-        // fileAppenders.push_back(std::move(ap));
-        fileAppenders.emplace_back(filename);
+        std::uint64_t ret = 0;
+        for (const auto &count : perLevel) {
+            ret += count.load(std::memory_order_relaxed);
+        }
+        return ret;
     }
 };
 
 
-#pragma endregion
-//----------------------
-
+// see AsyncLogControl::useFlightRecorder()
+struct FlightRecorderPolicy
+{
+    LogLevel::T below      = LogLevel::Info;  // records below are only kept in memory
+    LogLevel::T trigger    = LogLevel::Error; // a record at or above writes out what is kept
+    std::size_t maxRecords = 4096;
+    std::size_t maxBytes   = 4 << 20; // approximate, records, text and deferred arguments; 0 = only maxRecords
+};
 
-struct LOG_CC_API LoggerBase
+// Fixed ring of records as they came off the queue: deferred ones stay unrendered until
+// they are replayed, so a record that is never needed costs a move and nothing else.
+struct FlightRecorder
 {
-    Config          config;
-    ConsoleAppender consoleAppender;
+    FlightRecorderPolicy policy;
 
-    using formatter_t     = std::function<bool(const Config &config, std::string &output, LogLevel::T, std::string_view, const std::source_location &)>;
-    formatter_t formatter = nullptr;
+    void setPolicy(const FlightRecorderPolicy &policy)
+    {
+        this->policy = policy;
+        slots.clear();
+        slots.resize(std::max<std::size_t>(policy.maxRecords, 1));
+        head = count = bytes = 0;
+    }
 
+    bool bEnabled() const { return !slots.empty(); }
+    bool empty() const { return count == 0; }
 
-    LoggerBase()
+    // Overwrites the oldest record when full
+    void push(MessageElem &&elem)
     {
-        if (!formatter) {
-            formatter = DefaultFormatter{};
+        std::size_t size = recordBytes(elem);
+        if (count == slots.size()) {
+            bytes -= recordBytes(slots[head]); // overwritten below
+            head = (head + 1) % slots.size();
+            --count;
+        }
+        while (policy.maxBytes && count > 0 && bytes + size > policy.maxBytes) {
+            bytes -= recordBytes(slots[head]);
+            slots[head] = {};
+            head = (head + 1) % slots.size();
+            --count;
         }
+        slots[(head + count) % slots.size()] = std::move(elem);
+        ++count;
+        bytes += size;
     }
 
-    void setFormatter(formatter_t formatter_)
+    // Moves every record, oldest first, to the end of `out`
+    void drainTo(std::vector<MessageElem> &out)
     {
-        formatter = formatter_;
+        for (; count > 0; --count) {
+            out.push_back(std::move(slots[head]));
+            slots[head] = {};
+            head        = (head + 1) % slots.size();
+        }
+        bytes = 0;
     }
-};
 
-struct LOG_CC_API AsyncLogger : public LoggerBase
-{
-    using Super = LoggerBase;
-    std::shared_ptr<AsyncLogControl> logCore;
+    const MessageElem &oldest() const { return slots[head]; }
+    std::size_t        size() const { return count; }
 
-    AsyncLogger(std::shared_ptr<AsyncLogControl> logCore)
-        : LoggerBase()
+  private:
+    // records are kept before the worker renders them: deferred arguments count too
+    static std::size_t recordBytes(const MessageElem &elem)
     {
-        this->logCore = logCore;
+        return sizeof(MessageElem) + elem.msg.size() + elem.deferred.args.heapBytes();
     }
 
+    std::vector<MessageElem> slots;
+    std::size_t              head  = 0;
+    std::size_t              count = 0;
+    std::size_t              bytes = 0;
+};
 
-    void log(LogLevel::T level, std::string_view msg, std::source_location location = std::source_location::current())
+
+// Record buffers the worker hands back once they are written, so a producer formats the
+// next record into a recycled string instead of allocating one per record.
+// Producers take a few at a time into a thread-local stash; the worker returns a whole
+// batch under one lock. Bounded: surplus and oversized buffers are freed.
+struct BufferPool
+{
+    static constexpr std::size_t MaxBuffers  = 4096;
+    static constexpr std::size_t MaxCapacity = 4096; // bigger ones are not worth keeping
+    static constexpr std::size_t RefillCount = 32;
+
+    // producer: a buffer for the next record, empty and with `sizeHint` capacity if the
+    // pool has none
+    std::string take(std::size_t sizeHint)
     {
-        if (level < config.logLevel) {
-            return;
+        // shared by every pool: a buffer is just a string wherever it came from
+        thread_local std::vector<std::string> stash;
+        if (stash.empty() && bAvailable.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::size_t                 n = std::min(buffers.size(), RefillCount);
+            std::move(buffers.end() - (std::ptrdiff_t)n, buffers.end(), std::back_inserter(stash));
+            buffers.resize(buffers.size() - n);
+            bAvailable.store(!buffers.empty(), std::memory_order_relaxed);
         }
-        std::string output;
-        if (formatter(config, output, level, msg, location)) {
-            logCore->push(std::move(output), level);
+        if (stash.empty()) {
+            std::string ret;
+            ret.reserve(sizeHint);
+            return ret;
+        }
+        std::string ret = std::move(stash.back());
+        stash.pop_back();
+        return ret;
+    }
+
+    // worker: takes the buffers of records that have been written
+    void give(std::vector<MessageElem> &batch)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &elem : batch) {
+            if (buffers.size() >= MaxBuffers) {
+                break;
+            }
+            if (elem.msg.capacity() > 0 && elem.msg.capacity() <= MaxCapacity) {
+                elem.msg.clear();
+                buffers.push_back(std::move(elem.msg));
+            }
         }
+        bAvailable.store(!buffers.empty(), std::memory_order_relaxed);
     }
+
+  private:
+    std::mutex               mutex;
+    std::vector<std::string> buffers;
+    std::atomic<bool>        bAvailable{false}; // producers skip the lock while empty
 };
 
-struct SyncLogger : public LoggerBase
+
+struct MessageQueue
 {
-    std::atomic<bool>         bProcessing = false;
-    std::vector<FileAppender> fileAppenders;
 
 
-    LOG_CC_API SyncLogger()
-        : LoggerBase()
+    std::vector<MessageElem> queue;
+    // Once a DropOldest queue is full it is a ring: the oldest record is queue[head] and gets
+    // overwritten by the next one, so the queue never holds more than limit.capacity records
+    std::size_t             head = 0;
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::condition_variable spaceCv; // producers blocked on a full queue
+    bool                    bShutdown = false;
+    bool                    bParked   = false; // the worker waits on `cv`, push() has to notify it
+    std::atomic<bool>       bPending{false};   // for the worker's polls without the mutex
+
+    WaitStrategy wait;
+
+    QueueLimit    limit;
+    DropCounters *dropped = nullptr;
+
+  public:
+
+    void push(MessageElem &&elem)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool                         bFull = limit.capacity > 0 && queue.size() >= limit.capacity;
+        if (bFull && limit.policy == EOverflowPolicy::DropOldest) {
+            countDrop(queue[head].level);
+            queue[head] = std::move(elem);
+            head        = (head + 1) % queue.size();
+        }
+        else {
+            if (bFull) {
+                switch (limit.policy) {
+                case EOverflowPolicy::DropNewest:
+                    countDrop(elem.level);
+                    return;
+                case EOverflowPolicy::DropBelowLevel:
+                    if (elem.level < limit.dropBelow) {
+                        countDrop(elem.level);
+                        return;
+                    }
+                    [[fallthrough]];
+                default: // Block
+                    spaceCv.wait(lock, [this]() {
+                        return queue.size() < limit.capacity || bShutdown;
+                    });
+                    break;
+                }
+            }
+            queue.emplace_back(std::move(elem));
+        }
+        bPending.store(true, std::memory_order_relaxed);
+        bool bWake = bParked;
+        lock.unlock();
+        if (bWake) {
+            cv.notify_one();
+        }
+    }
+
+    // Swap the whole backlog into `batch` (whose capacity is handed back to the queue).
+    // `batch` is left empty when nothing arrived within `timeout`.
+    // Returns false once shut down and drained.
+    bool popAll(std::vector<MessageElem> &batch, std::chrono::milliseconds timeout)
     {
+        batch.clear();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        wait.poll(deadline, [this]() {
+            return bPending.load(std::memory_order_relaxed);
+        });
+        std::unique_lock<std::mutex> lock(mutex); // this will lock automatically! double lock cause a error
+        auto                         bReady = [this]() {
+            return !queue.empty() || bShutdown;
+        };
+        if (!bReady()) {
+            bParked = true;
+            cv.wait_until(lock, deadline, bReady);
+            bParked = false;
+        }
+        if (queue.empty()) {
+            return !bShutdown;
+        }
+        if (head > 0) {
+            // back in order, oldest first
+            std::rotate(queue.begin(), queue.begin() + (std::ptrdiff_t)head, queue.end());
+            head = 0;
+        }
+        queue.swap(batch);
+        bPending.store(false, std::memory_order_relaxed);
+        spaceCv.notify_all();
+        return true;
     }
 
-    SyncLogger(SyncLogger &&) noexcept            = default;
-    SyncLogger &operator=(SyncLogger &&) noexcept = delete;
-    SyncLogger(const SyncLogger &)                = delete;
-    SyncLogger &operator=(const SyncLogger &)     = delete;
 
-    LOG_CC_API void log(LogLevel::T level, std::string_view msg, std::source_location location = std::source_location::current())
+    void shutdown()
     {
-#ifdef LOG_CC_PROFILE_ENABLE
-        using clock_t = std::chrono::steady_clock;
-        auto now      = clock_t::now();
-#endif
-        if (level < config.logLevel) {
-            return;
-        }
-        std::string output;
-        formatter(config, output, level, msg, location);
+        std::lock_guard<std::mutex> lock(mutex);
+        bShutdown = true;
+        cv.notify_all();
+        spaceCv.notify_all();
+    }
 
-        // wait io
-        while (bProcessing.load() == true) {
+  private:
+    void countDrop(LogLevel::T level)
+    {
+        if (dropped) {
+            dropped->count(level);
         }
-        bProcessing.store(true);
+    }
+};
+
+struct AsyncLogControl
+{
+    AsyncLogControl()                                    = default;
+    AsyncLogControl(const AsyncLogControl &)                     = delete;
+    AsyncLogControl(AsyncLogControl &&)                          = delete;
+    AsyncLogControl          &operator=(const AsyncLogControl &) = delete;
+    AsyncLogControl          &operator=(AsyncLogControl &&)      = delete;
+    std::vector<FileAppender>                   fileAppenders;
+    std::vector<std::unique_ptr<AsyncAppender>> appenders;
+    ConsoleAppender                             consoleAppender;
+    // rendered by the worker in front of every record, set before run()
+    ETimePrecision timePrecision = ETimePrecision::None;
+    // for the records the worker writes itself (drop reports, stats, repeats, the flight
+    // recorder header), see setFormatter()
+    FormatterFunc    formatter = DefaultFormatter{};
+    FieldEncoderFunc fieldEncoder;
+    // how often fileAppenders are flushed
+    std::chrono::seconds flushInterval{10};
+    // longest the worker waits for records before running its periodic tasks
+    std::chrono::milliseconds pollInterval{100};
+
+    std::thread  workerThread;
+    MessageQueue msgQueue;
+    // set by useLockFreeQueue(), takes the place of msgQueue
+    std::unique_ptr<MpscRingQueue<MessageElem>> ringQueue;
+    // set by useThreadLocalQueues(), takes the place of msgQueue
+    std::unique_ptr<ThreadQueueSet<MessageElem>> threadQueues;
+    // set by useBinaryFile(), then the only output of the worker
+    std::unique_ptr<BinaryFileAppender> binaryFile;
+    // set by useSinkThreads(): batches waiting per sink before the worker blocks, 0 = no sink threads
+    std::size_t sinkMaxPendingBatches = 0;
+    // set by setQueueLimit()
+    QueueLimit   queueLimit;
+    DropCounters dropped;
+    // written record buffers, reused by AsyncLogger::emit()
+    BufferPool bufferPool;
+    // how often the worker logs how many records were dropped since the last report
+    std::chrono::seconds dropReportInterval{10};
+    // how often the worker logs stats() as an Info record, 0 = never
+    std::chrono::seconds statsInterval{0};
+    // set by setWaitStrategy() / setWorkerPlacement()
+    WaitStrategy    waitStrategy;
+    ThreadPlacement workerPlacement;
+    // see stats(); sinkCounters are created by run(), in the order of sinkCounter()
+    PipelineCounters         pipeline;
+    std::deque<SinkCounters> sinkCounters;
+
+    std::chrono::steady_clock::time_point lastFlush; // worker only
+    bool bFlushAll = false; // worker only: flushAll() after this batch, see recordFlight()
+    std::chrono::steady_clock::time_point lastDropReport; // worker only
+    std::chrono::steady_clock::time_point lastStatsReport; // worker only
+    std::array<std::uint64_t, LogLevel::Count> reportedDrops{}; // worker only
+    // worker only, see useSinkThreads()
+    std::vector<std::unique_ptr<AsyncAppender>> sinkAdapters;
+    std::vector<std::unique_ptr<SinkWorker>>    sinkWorkers;
+    // worker only, see setSuppressDuplicates()
+    DuplicateFilter          duplicateFilter;
+    std::vector<MessageElem> deduped;
+    // worker only, see useFlightRecorder()
+    FlightRecorder           flightRecorder;
+    std::vector<MessageElem> flightBatch;
+    TimestampFormatter       timestampFormatter; // worker only
+    // worker only, see renderSite()
+    struct SitePrefixKey
+    {
+        const CallSiteMeta   *site;
+        const SitePrefixFunc *formatter;
+        bool                  bDetail; // level >= logDetailLevel
 
+        bool operator==(const SitePrefixKey &) const = default;
+    };
+    struct SitePrefixKeyHash
+    {
+        std::size_t operator()(const SitePrefixKey &key) const
         {
-            MessageElem elem{.level = level, .msg = std::move(output)};
-            consoleAppender << elem;
-            for (auto &fileAppender : fileAppenders) {
-                fileAppender << elem;
-            }
+            return std::hash<const void *>{}(key.site) ^ (std::hash<const void *>{}(key.formatter) << 1) ^ key.bDetail;
+        }
+    };
+    struct SitePrefix
+    {
+        std::shared_ptr<const SitePrefixFunc> owner; // keeps the formatter's address from being reused
+        std::string                           prefix;
+    };
+    std::unordered_map<SitePrefixKey, SitePrefix, SitePrefixKeyHash> sitePrefixes;
+    std::size_t              sitePrefixPruneSize = 256; // sitePrefixes size that triggers pruneSitePrefixes()
+    std::string              stamp;                     // worker only
+
+
+    ~AsyncLogControl()
+    {
+        msgQueue.shutdown();
+        if (ringQueue) {
+            ringQueue->shutdown();
+        }
+        if (threadQueues) {
+            threadQueues->shutdown();
+        }
+        if (workerThread.joinable()) {
+            workerThread.join();
         }
-        // reset io
-        bProcessing.store(false);
-#ifdef LOG_CC_PROFILE_ENABLE
-        auto gap = clock_t::now();
-        auto ns  = std::chrono::duration_cast<std::chrono::nanoseconds>(gap - now).count();
-        printf("cost: %f ms(%lld ns)\n", (double)ns / 1000000.0, ns);
-#endif
     }
+
+    void run()
+    {
+        initSinkCounters();
+        msgQueue.wait = waitStrategy;
+        if (ringQueue) {
+            ringQueue->wait = waitStrategy;
+        }
+        if (threadQueues) {
+            threadQueues->wait = waitStrategy;
+        }
+        workerThread = std::thread([this]() {
+            if (!workerPlacement.cpus.empty() || workerPlacement.nice != 0 || workerPlacement.realtimePriority > 0) {
+                applyThreadPlacement(workerPlacement);
+            }
+            std::vector<MessageElem> batch;
+            lastFlush       = std::chrono::steady_clock::now();
+            lastDropReport  = lastFlush;
+            lastStatsReport = lastFlush;
+            if (sinkMaxPendingBatches > 0 && !binaryFile) {
+                startSinkWorkers();
+            }
+            for (;;) {
+                auto waitStart = std::chrono::steady_clock::now();
+                if (!popAll(batch)) {
+                    break;
+                }
+                auto workStart = std::chrono::steady_clock::now();
+                pipeline.idleNs.fetch_add(elapsedNs(waitStart, workStart), std::memory_order_relaxed);
+                if (!batch.empty()) {
+                    pipeline.recordBatch(batch.size(), dropped.total());
+                }
+                process(batch);
+                pipeline.busyNs.fetch_add(elapsedNs(workStart), std::memory_order_relaxed);
+            }
+
+            if (duplicateFilter.bEnabled && !binaryFile) {
+                batch.clear();
+                suppressDuplicates(batch); // the repeats still pending
+                deliver(batch);
+            }
+            if (!sinkWorkers.empty()) {
+                sinkWorkers.clear(); // drains and joins every sink
+                sinkAdapters.clear();
+                return;
+            }
+            flushAll();
+        });
+    }
+
+    // worker only: one batch from popAll(), possibly empty
+    void process(std::vector<MessageElem> &batch)
+    {
+        reportDrops(batch);
+        reportStats(batch);
+        if (flightRecorder.bEnabled()) {
+            recordFlight(batch);
+        }
+        for (auto &elem : batch) {
+            if (elem.site && elem.deferred.sitePrefix) {
+                renderSite(elem);
+            }
+            else if (elem.deferred) {
+                elem.deferred.render(elem.level, elem.timestamp, elem.msg);
+            }
+        }
+
+        if (binaryFile) {
+            // binary records are decoded and everything is stamped later by log.cc.decode
+            if (!batch.empty()) {
+                auto start = std::chrono::steady_clock::now();
+                binaryFile->write(batch);
+                sinkCounter(ESink::Binary).addWrite(batch.size(), byteCount(batch), elapsedNs(start));
+            }
+            flushTask();
+        }
+        else {
+            if (duplicateFilter.bEnabled) {
+                suppressDuplicates(batch);
+            }
+            deliver(batch);
+        }
+        if (bFlushAll) {
+            bFlushAll = false;
+            flushAll();
+        }
+    }
+
+    // Constructs an appender of type T in place; it is then owned and driven by the worker.
+    // Must be called before run()
+    template <typename T, typename... Args>
+    T &addAppender(Args &&...args)
+    {
+        assert(!workerThread.joinable());
+        auto holder = std::make_unique<AsyncAppenderOf<T>>(std::forward<Args>(args)...);
+        T   &ret    = holder->appender;
+        appenders.push_back(std::move(holder));
+        return ret;
+    }
+
+    void setTimePrecision(ETimePrecision precision)
+    {
+        timePrecision = precision;
+    }
+
+    // Formats the records the worker writes itself, the DefaultFormatter unless set.
+    // Give it the loggers' JsonEncoder / LogfmtEncoder so these come out as JSON / logfmt
+    // too, the counts as fields. Must be called before run()
+    void setFormatter(FormatterFunc formatter_)
+    {
+        assert(!workerThread.joinable());
+        formatter    = std::move(formatter_);
+        fieldEncoder = nullptr;
+    }
+
+    template <FieldEncoder E>
+    void setFormatter(E encoder)
+    {
+        setFormatter(FormatterFunc(encoder));
+        fieldEncoder = [encoder](const Config &config, std::string &output, LogLevel::T level, std::string_view msg,
+                                 std::span<const Field> fields, const std::source_location &location) {
+            encoder.encode(config, output, level, msg, fields, location);
+        };
+    }
+
+    // Switch to the bounded lock-free MPSC ring, must be called before run()
+    void useLockFreeQueue(std::size_t capacity = 8192)
+    {
+        assert(!workerThread.joinable());
+        ringQueue = std::make_unique<MpscRingQueue<MessageElem>>(capacity);
+    }
+
+    // Give every producing thread its own SPSC ring, polled by the worker;
+    // must be called before run()
+    void useThreadLocalQueues(std::size_t capacityPerThread = 1024)
+    {
+        assert(!workerThread.joinable());
+        threadQueues = std::make_unique<ThreadQueueSet<MessageElem>>(capacityPerThread);
+    }
+
+    // Give the console, every file appender and every addAppender() sink its own thread.
+    // The worker only dequeues and renders; a sink that falls `maxPendingBatches` behind
+    // (e.g. a blocked terminal) makes the worker wait, the other sinks keep writing.
+    // Must be called before run()
+    void useSinkThreads(std::size_t maxPendingBatches = 1024)
+    {
+        assert(!workerThread.joinable());
+        sinkMaxPendingBatches = maxPendingBatches;
+    }
+
+    // How the worker waits once the queue is empty: spin, yield, sleep, then park until a
+    // producer signals it. Producers only notify a parked worker, so a busy one costs them
+    // no syscall. {.sleeps = WaitStrategy::NeverPark} keeps it polling every `sleep` instead.
+    // Must be called before run()
+    void setWaitStrategy(const WaitStrategy &strategy)
+    {
+        assert(!workerThread.joinable());
+        waitStrategy = strategy;
+    }
+
+    // Pin the worker to `placement.cpus` and set its priority, e.g. to keep it off the
+    // latency critical cores: {.cpus = {7}, .nice = 5}. Must be called before run()
+    void setWorkerPlacement(const ThreadPlacement &placement)
+    {
+        assert(!workerThread.joinable());
+        workerPlacement = placement;
+    }
+
+    // Keep the records below `policy.below` in a fixed in-memory ring instead of writing them,
+    // and write the ring out in front of the next record at or above `policy.trigger`:
+    // Debug context for an Error at no I/O cost. Every sink is flushed right after, so the
+    // context is on disk should the process die next. The logger's own level still has to
+    // let the records through. Must be called before run()
+    void useFlightRecorder(const FlightRecorderPolicy &policy = {})
+    {
+        assert(!workerThread.joinable());
+        flightRecorder.setPolicy(policy);
+    }
+
+    // Collapse consecutive identical records (after rendering, before the timestamp) into
+    // one "last message repeated N times" line; must be called before run()
+    void setSuppressDuplicates(bool bSuppress)
+    {
+        assert(!workerThread.joinable());
+        duplicateFilter.bEnabled = bSuppress;
+    }
+
+    // Bound the queue and choose what happens when it is full; must be called before run().
+    // `capacity` only applies to the default queue, the rings keep the capacity given to
+    // useLockFreeQueue() / useThreadLocalQueues(). A ring cannot give up its oldest
+    // record from the producer side, so DropOldest discards the newest one there.
+    void setQueueLimit(QueueLimit limit)
+    {
+        assert(!workerThread.joinable());
+        queueLimit       = limit;
+        msgQueue.limit   = limit;
+        msgQueue.dropped = &dropped;
+    }
+
+    // Records dropped so far at `level`
+    std::uint64_t droppedCount(LogLevel::T level) const
+    {
+        return dropped.perLevel[LogLevel::toIndex(level)].load(std::memory_order_relaxed);
+    }
+
+    // Write every record to `filename` in the binary format of binary_log.h instead of the
+    // text appenders; AsyncLogger::logBinary() then only encodes its arguments.
+    // Must be called before run()
+    void useBinaryFile(std::string_view filename)
+    {
+        assert(!workerThread.joinable());
+        binaryFile = std::make_unique<BinaryFileAppender>(filename);
+    }
+
+    void push(std::string &&msg, LogLevel::T level = LogLevel::Info)
+    {
+        push(MessageElem{
+            .level = level,
+            .msg   = std::move(msg),
+        });
+    }
+
+    void push(MessageElem &&elem)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (elem.timestamp == 0) {
+            elem.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count(); // timestampNow()
+        }
+        if (ringQueue) {
+            if (!bMayDrop(elem.level)) {
+                ringQueue->push(std::move(elem));
+            }
+            else if (!ringQueue->tryPush(std::move(elem))) {
+                dropped.count(elem.level);
+            }
+        }
+        else if (threadQueues) {
+            if (!bMayDrop(elem.level)) {
+                threadQueues->push(std::move(elem));
+            }
+            else if (!threadQueues->tryPush(std::move(elem))) {
+                dropped.count(elem.level);
+            }
+        }
+        else {
+            msgQueue.push(std::move(elem));
+        }
+        pipeline.recordPush(elapsedNs(start));
+    }
+
+    // for the rings: whether a record of `level` is discarded rather than waited for
+    bool bMayDrop(LogLevel::T level) const
+    {
+        switch (queueLimit.policy) {
+        case EOverflowPolicy::Block:
+            return false;
+        case EOverflowPolicy::DropBelowLevel:
+            return level < queueLimit.dropBelow;
+        default:
+            return true;
+        }
+    }
+
+    // worker only: every dropReportInterval, appends a summary of the records dropped since the last one
+    void reportDrops(std::vector<MessageElem> &batch)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastDropReport < dropReportInterval) {
+            return;
+        }
+        lastDropReport = now;
+
+        std::uint64_t total = 0;
+        std::array<std::uint64_t, LogLevel::Count> deltas{};
+        for (std::size_t i = 0; i < LogLevel::Count; ++i) {
+            std::uint64_t count = dropped.perLevel[i].load(std::memory_order_relaxed);
+            deltas[i]           = count - reportedDrops[i];
+            reportedDrops[i]    = count;
+            total += deltas[i];
+        }
+        if (total == 0) {
+            return;
+        }
+        std::vector<Field> fields{{"dropped", total}};
+        for (std::size_t i = 0; i < LogLevel::Count; ++i) {
+            if (deltas[i] > 0) {
+                fields.emplace_back(LogLevel::levelStrings[i], deltas[i]);
+            }
+        }
+        batch.push_back(ownRecord(LogLevel::Warn, "log.cc: records dropped by the queue overflow policy", fields, timestampNow()));
+    }
+
+    // worker only: a record of the worker's own, through formatter / fieldEncoder
+    MessageElem ownRecord(LogLevel::T level, std::string_view msg, std::span<const Field> fields, std::int64_t timestamp)
+    {
+        static const Config config{.logDetailLevel = Config::NoDetail};
+        MessageElem elem{.level = level, .timestamp = timestamp};
+        formatFields(formatter, fieldEncoder, config, elem.msg, level, msg, fields, std::source_location::current());
+        return elem;
+    }
+
+    // worker only: see useFlightRecorder()
+    void recordFlight(std::vector<MessageElem> &batch)
+    {
+        const FlightRecorderPolicy &policy = flightRecorder.policy;
+        flightBatch.clear();
+        for (auto &elem : batch) {
+            if (elem.level < policy.below) {
+                flightRecorder.push(std::move(elem));
+                continue;
+            }
+            if (elem.level >= policy.trigger && !flightRecorder.empty()) {
+                const Field fields[] = {{"records", flightRecorder.size()}, {"trigger", LogLevel::levelStrings[LogLevel::toIndex(elem.level)]}};
+                flightBatch.push_back(ownRecord(LogLevel::Info, "log.cc: flight recorder, the records before this trigger", fields,
+                                                flightRecorder.oldest().timestamp));
+                flightRecorder.drainTo(flightBatch);
+                bFlushAll = true; // every sink, once this batch is written
+            }
+            flightBatch.push_back(std::move(elem));
+        }
+        batch.swap(flightBatch);
+    }
+
+    // worker only: every statsInterval, appends stats() as a record
+    void reportStats(std::vector<MessageElem> &batch)
+    {
+        if (statsInterval.count() == 0) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastStatsReport < statsInterval) {
+            return;
+        }
+        lastStatsReport = now;
+        AsyncLogStats stats = this->stats();
+        std::string   sinks = stats.sinksToString();
+        const Field   fields[] = {
+            {"pushed", stats.pushed},
+            {"dequeued", stats.dequeued},
+            {"dropped", stats.droppedTotal()},
+            {"depth", stats.queueDepth},
+            {"high_water", stats.queueHighWater},
+            {"batches", stats.batches},
+            {"enqueue_avg_ns", stats.pushed > 0 ? stats.enqueueNs / stats.pushed : 0},
+            {"enqueue_max_ns", stats.enqueueMaxNs},
+            {"worker_busy_ms", stats.workerBusyNs / 1000000},
+            {"worker_idle_ms", stats.workerIdleNs / 1000000},
+            {"sinks", sinks},
+        };
+        batch.push_back(ownRecord(LogLevel::Info, "log.cc: stats", fields, timestampNow()));
+    }
+
+    // `batch` may come back empty when nothing arrived within pollInterval
+    bool popAll(std::vector<MessageElem> &batch)
+    {
+        if (ringQueue) {
+            return ringQueue->popAll(batch, pollInterval);
+        }
+        if (threadQueues) {
+            if (!threadQueues->popAll(batch, pollInterval)) {
+                return false;
+            }
+            // each ring is already in order, merge them by timestamp
+            std::stable_sort(batch.begin(), batch.end(), [](const MessageElem &a, const MessageElem &b) {
+                return a.timestamp < b.timestamp;
+            });
+            return true;
+        }
+        return msgQueue.popAll(batch, pollInterval);
+    }
+
+    void flushTask()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastFlush >= flushInterval) {
+            for (std::size_t i = 0; i < fileAppenders.size(); ++i) {
+                auto start = std::chrono::steady_clock::now();
+                fileAppenders[i].flush();
+                sinkCounter(ESink::File, i).addFlush(elapsedNs(start));
+            }
+            if (binaryFile) {
+                auto start = std::chrono::steady_clock::now();
+                binaryFile->flush();
+                sinkCounter(ESink::Binary).addFlush(elapsedNs(start));
+            }
+            lastFlush = now;
+        }
+        for (auto &appender : appenders) {
+            appender->poll();
+        }
+    }
+
+    // worker only: every sink, right away; sink threads flush once they have written what
+    // was handed to them so far
+    void flushAll()
+    {
+        for (auto &sink : sinkWorkers) {
+            sink->requestFlush();
+        }
+        if (!sinkWorkers.empty()) {
+            return;
+        }
+        for (std::size_t i = 0; i < fileAppenders.size(); ++i) {
+            auto start = std::chrono::steady_clock::now();
+            fileAppenders[i].flush();
+            sinkCounter(ESink::File, i).addFlush(elapsedNs(start));
+        }
+        for (std::size_t i = 0; i < appenders.size(); ++i) {
+            auto start = std::chrono::steady_clock::now();
+            appenders[i]->flush();
+            sinkCounter(ESink::Appender, i).addFlush(elapsedNs(start));
+        }
+        if (binaryFile) {
+            auto start = std::chrono::steady_clock::now();
+            binaryFile->flush();
+            sinkCounter(ESink::Binary).addFlush(elapsedNs(start));
+        }
+        lastFlush = std::chrono::steady_clock::now();
+    }
+
+    // worker only: a CallSiteMeta record, its prefix is rendered once per site and formatter
+    void renderSite(MessageElem &elem)
+    {
+        const DeferredMessage &deferred = elem.deferred;
+        SitePrefixKey          key{elem.site, deferred.sitePrefix.get(), elem.level >= deferred.config.logDetailLevel};
+        if (sitePrefixes.size() >= sitePrefixPruneSize) {
+            pruneSitePrefixes();
+        }
+        auto [it, bInserted] = sitePrefixes.try_emplace(key);
+        if (bInserted) {
+            it->second.owner = deferred.sitePrefix;
+            (*deferred.sitePrefix)(deferred.config, it->second.prefix, elem.level, elem.site->file, elem.site->line);
+        }
+        elem.msg = it->second.prefix;
+        deferred.args.formatTo(elem.msg, elem.site->fmt);
+        elem.msg.push_back('\n');
+    }
+
+    // worker only: forgets the prefixes of formatters no logger or queued record holds any
+    // more (replaced by setFormatter()), which also releases those formatters
+    void pruneSitePrefixes()
+    {
+        // a formatter still referenced only by its own entries is unused; counted for every
+        // formatter before anything is erased, erasing drops the use counts
+        struct Refs
+        {
+            long entries = 0;
+            long uses    = 0;
+        };
+        std::unordered_map<const SitePrefixFunc *, Refs> refs;
+        for (const auto &[key, value] : sitePrefixes) {
+            Refs &ref = refs[key.formatter];
+            ++ref.entries;
+            ref.uses = value.owner.use_count();
+        }
+        std::erase_if(sitePrefixes, [&refs](const auto &entry) {
+            const Refs &ref = refs[entry.first.formatter];
+            return ref.uses == ref.entries;
+        });
+        sitePrefixPruneSize = std::max<std::size_t>(256, sitePrefixes.size() * 2);
+    }
+
+    // worker only: stamps the batch and hands it to the sinks
+    void deliver(std::vector<MessageElem> &batch)
+    {
+        if (timePrecision != ETimePrecision::None) {
+            for (auto &elem : batch) {
+                stamp.clear();
+                timestampFormatter.append(stamp, elem.timestamp, timePrecision);
+                stamp.push_back(' ');
+                elem.msg.insert(0, stamp);
+            }
+        }
+
+        if (!sinkWorkers.empty()) {
+            if (!batch.empty()) {
+                SinkWorker::batch_t shared = std::make_shared<std::vector<MessageElem>>(std::move(batch));
+                for (auto &sink : sinkWorkers) {
+                    sink->push(shared);
+                }
+                batch.clear(); // moved from
+            }
+            return; // sinks flush and poll on their own threads
+        }
+
+        if (!batch.empty()) {
+            std::size_t bytes = byteCount(batch);
+            auto        start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < fileAppenders.size(); ++i) {
+                fileAppenders[i].write(batch);
+                start = addWrite(sinkCounter(ESink::File, i), batch.size(), bytes, start);
+            }
+            for (std::size_t i = 0; i < appenders.size(); ++i) {
+                appenders[i]->write(batch);
+                start = addWrite(sinkCounter(ESink::Appender, i), batch.size(), bytes, start);
+            }
+
+            consoleAppender.write(batch);
+            addWrite(sinkCounter(ESink::Console), batch.size(), bytes, start);
+            bufferPool.give(batch);
+        }
+
+        flushTask();
+    }
+
+    // worker only: drops records that repeat the previous one; the repeat count goes in front
+    // of the next different record, or out on its own once a poll brings no records
+    void suppressDuplicates(std::vector<MessageElem> &batch)
+    {
+        std::uint64_t repeats     = 0;
+        LogLevel::T   repeatLevel = LogLevel::Info;
+        auto          repeated    = [&](std::int64_t timestamp) {
+            const Field fields[] = {{DuplicateFilter::RepeatField, repeats}};
+            return ownRecord(repeatLevel, DuplicateFilter::RepeatMessage, fields, timestamp);
+        };
+        if (batch.empty()) {
+            if (duplicateFilter.takeRepeats(repeats, repeatLevel)) {
+                batch.push_back(repeated(timestampNow()));
+            }
+            return;
+        }
+
+        deduped.clear();
+        for (auto &elem : batch) {
+            if (!duplicateFilter.pass(elem.level, elem.msg, repeats, repeatLevel)) {
+                continue;
+            }
+            if (repeats > 0) {
+                deduped.push_back(repeated(elem.timestamp));
+            }
+            deduped.push_back(std::move(elem));
+        }
+        batch.swap(deduped);
+    }
+
+    // worker only
+    void startSinkWorkers()
+    {
+        for (std::size_t i = 0; i < fileAppenders.size(); ++i) {
+            SinkCounters &counters = sinkCounter(ESink::File, i);
+            sinkAdapters.push_back(std::make_unique<AsyncAppenderRef<FileAppender>>(fileAppenders[i], flushInterval, counters));
+            sinkWorkers.push_back(std::make_unique<SinkWorker>(*sinkAdapters.back(), counters, pollInterval, sinkMaxPendingBatches));
+        }
+        SinkCounters &consoleCounters = sinkCounter(ESink::Console);
+        sinkAdapters.push_back(std::make_unique<AsyncAppenderRef<ConsoleAppender>>(consoleAppender, flushInterval, consoleCounters));
+        sinkWorkers.push_back(std::make_unique<SinkWorker>(*sinkAdapters.back(), consoleCounters, pollInterval, sinkMaxPendingBatches));
+        for (std::size_t i = 0; i < appenders.size(); ++i) {
+            sinkWorkers.push_back(std::make_unique<SinkWorker>(*appenders[i], sinkCounter(ESink::Appender, i), pollInterval, sinkMaxPendingBatches));
+        }
+    }
+
+    // sinkCounters: fileAppenders, appenders, the console, binaryFile
+    enum class ESink
+    {
+        File,
+        Appender,
+        Console,
+        Binary,
+    };
+
+    SinkCounters &sinkCounter(ESink sink, std::size_t index = 0)
+    {
+        switch (sink) {
+        case ESink::File:
+            return sinkCounters[index];
+        case ESink::Appender:
+            return sinkCounters[fileAppenders.size() + index];
+        case ESink::Console:
+            return sinkCounters[fileAppenders.size() + appenders.size()];
+        default:
+            return sinkCounters[fileAppenders.size() + appenders.size() + 1];
+        }
+    }
+
+    void initSinkCounters()
+    {
+        sinkCounters.clear();
+        for (auto &fileAppender : fileAppenders) {
+            sinkCounters.emplace_back(fileAppender.filename);
+        }
+        for (auto &appender : appenders) {
+            sinkCounters.emplace_back(appender->name());
+        }
+        sinkCounters.emplace_back("console");
+        if (binaryFile) {
+            sinkCounters.emplace_back(binaryFile->filename);
+        }
+    }
+
+    // Counts a write that began at `start`; returns its end, where the next sink's write begins
+    static std::chrono::steady_clock::time_point addWrite(SinkCounters &counters, std::size_t records, std::size_t bytes,
+                                                          std::chrono::steady_clock::time_point start)
+    {
+        auto end = std::chrono::steady_clock::now();
+        counters.addWrite(records, bytes, elapsedNs(start, end));
+        return end;
+    }
+
+    // Counters so far; safe to call from any thread once run() was called
+    AsyncLogStats stats() const
+    {
+        AsyncLogStats ret;
+        for (const PipelineCounters::Stripe &stripe : pipeline.stripes) {
+            ret.pushed += stripe.pushed.load(std::memory_order_relaxed);
+            ret.enqueueNs += stripe.enqueueNs.load(std::memory_order_relaxed);
+            ret.enqueueMaxNs = std::max(ret.enqueueMaxNs, stripe.enqueueMaxNs.load(std::memory_order_relaxed));
+        }
+        ret.dequeued       = pipeline.dequeued.load(std::memory_order_relaxed);
+        ret.batches        = pipeline.batches.load(std::memory_order_relaxed);
+        ret.queueHighWater = pipeline.highWater.load(std::memory_order_relaxed);
+        ret.workerBusyNs   = pipeline.busyNs.load(std::memory_order_relaxed);
+        ret.workerIdleNs   = pipeline.idleNs.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < LogLevel::Count; ++i) {
+            ret.dropped[i] = dropped.perLevel[i].load(std::memory_order_relaxed);
+        }
+        // the counters are not read at one instant, depth may be off by the records in flight
+        std::uint64_t gone = ret.dequeued + ret.droppedTotal();
+        ret.queueDepth     = ret.pushed > gone ? ret.pushed - gone : 0;
+        for (const SinkCounters &counters : sinkCounters) {
+            ret.sinks.push_back(counters.snapshot());
+        }
+        return ret;
+    }
+
+    void addFileAppender(std::string_view filename)
+    {
+        // auto ap = FileAppender(filename);
+        // fileAppenders.push_back(std::move(ap));
+        fileAppenders.emplace_back(filename);
+    }
+};
+
+
+#pragma endregion
+//----------------------
+
+
+struct LOG_CC_API LoggerBase
+{
+    Config          config;
+    ConsoleAppender consoleAppender;
+
+    using formatter_t     = FormatterFunc;
+    formatter_t formatter = nullptr;
+    // copy of `formatter` that deferred records keep alive until the worker renders them
+    std::shared_ptr<const formatter_t> sharedFormatter;
+
+    using prefix_formatter_t = std::function<void(const Config &config, std::string &output, LogLevel::T, const std::source_location &)>;
+    prefix_formatter_t prefixFormatter = nullptr; // empty when the formatter has no appendPrefix()
+    // empty when the formatter has no appendPrefix(config, output, level, file, line)
+    std::shared_ptr<const SitePrefixFunc> sitePrefixFormatter;
+
+    using field_encoder_t = FieldEncoderFunc;
+    field_encoder_t fieldEncoder = nullptr; // set for a FieldEncoder formatter
+
+    using call_site_t = CallSiteMeta; // for LOG_CC_INFO() & co
+
+    // per call site limits, checked before anything is formatted
+    RateLimiter rateLimiter;
+    // set by setCategory(), then it decides the level instead of config.logLevel
+    const Category *category = nullptr;
+
+
+    LoggerBase()
+    {
+        setFormatter(DefaultFormatter{});
+    }
+    virtual ~LoggerBase() = default;
+
+    void setFormatter(formatter_t formatter_)
+    {
+        formatter       = formatter_;
+        sharedFormatter     = std::make_shared<const formatter_t>(formatter);
+        prefixFormatter     = nullptr;
+        sitePrefixFormatter = nullptr;
+        fieldEncoder        = nullptr;
+    }
+
+    // JsonEncoder, LogfmtEncoder: every record, structured or not, is rendered by the encoder
+    template <FieldEncoder E>
+    void setFormatter(E encoder)
+    {
+        setFormatter(formatter_t(encoder));
+        fieldEncoder = [encoder](const Config &config, std::string &output, LogLevel::T level, std::string_view msg,
+                                 std::span<const Field> fields, const std::source_location &location) {
+            encoder.encode(config, output, level, msg, fields, location);
+        };
+    }
+
+    // Take the level from the registry's category `name`, so it can be changed at runtime
+    // (CategoryRegistry::setLevel(), LOG_CC_LEVELS, a watched file).
+    // For the category in the prefix as well, also setFormatter(CategoryFormatter{name}).
+    void setCategory(std::string_view name)
+    {
+        category = &CategoryRegistry::instance().get(name);
+    }
+
+    bool bEnabled(LogLevel::T level) const
+    {
+        return category ? category->bEnabled(level) : level >= config.logLevel;
+    }
+
+    // Limit how often each call site of this logger may log, e.g. {.perSecond = 10, .burst = 100}
+    // or {.sampleEvery = 1000}. The next record a site does log is preceded by a line with the
+    // number of records it dropped. Must be set before logging; copies of the logger made
+    // afterwards share the buckets.
+    void setRateLimit(const RateLimit &limit)
+    {
+        rateLimiter.setLimit(limit);
+    }
+
+    template <PrefixFormatter F>
+    void setFormatter(F formatter_)
+    {
+        prefixFormatter = [formatter_](const Config &config, std::string &output, LogLevel::T level, const std::source_location &location) {
+            formatter_.appendPrefix(config, output, level, location);
+        };
+        if constexpr (requires(const F &f, const Config &config, std::string &output) {
+                          f.appendPrefix(config, output, LogLevel::Info, std::string_view{}, std::uint_least32_t{});
+                      })
+        {
+            sitePrefixFormatter = std::make_shared<const SitePrefixFunc>(
+                [formatter_](const Config &config, std::string &output, LogLevel::T level, std::string_view file, std::uint_least32_t line) {
+                    formatter_.appendPrefix(config, output, level, file, line);
+                });
+        }
+        else {
+            sitePrefixFormatter = nullptr;
+        }
+        fieldEncoder    = nullptr;
+        formatter       = std::move(formatter_);
+        sharedFormatter = std::make_shared<const formatter_t>(formatter);
+    }
+
+    // logger.info("x={} y={}", x, y);
+    // clang-format off
+    template <typename... Args> void debug(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args) { logFormat(LogLevel::Debug, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void trace(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args) { logFormat(LogLevel::Trace, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void info(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args)  { logFormat(LogLevel::Info, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void warn(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args)  { logFormat(LogLevel::Warn, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void error(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args) { logFormat(LogLevel::Error, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void fatal(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args) { logFormat(LogLevel::Fatal, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    // clang-format on
+
+    // Header and message are appended with std::format_to into the per-thread buffer,
+    // no intermediate message string unless the formatter lacks appendPrefix().
+    template <typename... Args>
+    void logFormat(LogLevel::T level, const std::source_location &location, std::format_string<Args...> fmt, Args &&...args)
+    {
+        if (!bEnabled(level)) {
+            return;
+        }
+        if (rateLimiter.bEnabled() && !admit(level, location)) {
+            return;
+        }
+        std::string &output = threadLocalBuffer();
+        output.clear();
+        if (prefixFormatter) {
+            prefixFormatter(config, output, level, location);
+            std::format_to(std::back_inserter(output), fmt, std::forward<Args>(args)...);
+            output.push_back('\n');
+        }
+        else {
+            std::string msg = std::format(fmt, std::forward<Args>(args)...);
+            if (!formatter(config, output, level, msg, location)) {
+                return;
+            }
+        }
+        emit(level, output);
+    }
+
+    // logger.log(LogLevel::Info, "login", {{"user_id", id}, {"latency_us", t}});
+    // The values are not formatted into the message: a FieldEncoder formatter writes them
+    // as JSON / logfmt, any other formatter gets them appended as " key=value" pairs.
+    void log(LogLevel::T level, std::string_view msg, std::initializer_list<Field> fields,
+             std::source_location location = std::source_location::current())
+    {
+        if (!bEnabled(level)) {
+            return;
+        }
+        if (rateLimiter.bEnabled() && !admit(level, location)) {
+            return;
+        }
+        std::span<const Field> span(fields.begin(), fields.size());
+        std::string           &output = threadLocalBuffer();
+        output.clear();
+        if (fieldEncoder) {
+            fieldEncoder(config, output, level, msg, span, location);
+        }
+        else if (prefixFormatter) {
+            prefixFormatter(config, output, level, location);
+            output += msg;
+            appendLogfmtFields(output, span);
+            output.push_back('\n');
+        }
+        else {
+            std::string text(msg);
+            appendLogfmtFields(text, span);
+            if (!formatter(config, output, level, text, location)) {
+                return;
+            }
+        }
+        emit(level, output);
+    }
+
+    // LOG_CC_INFO(logger, ...) & co: the prefix shows the call site's basename
+    template <typename... Args>
+    void logSite(const CallSiteMeta &site, std::format_string<Args...> fmt, Args &&...args)
+    {
+        if (!sitePrefixFormatter) {
+            logFormat(site.level, site.location, fmt, std::forward<Args>(args)...);
+            return;
+        }
+        if (!bEnabled(site.level)) {
+            return;
+        }
+        if (rateLimiter.bEnabled() && !admit(site.level, site.location)) {
+            return;
+        }
+        std::string &output = threadLocalBuffer();
+        output.clear();
+        (*sitePrefixFormatter)(config, output, site.level, site.file, site.line);
+        std::format_to(std::back_inserter(output), fmt, std::forward<Args>(args)...);
+        output.push_back('\n');
+        emit(site.level, output);
+    }
+
+  protected:
+    // Hand a finished record to the appenders; `record` is the reusable buffer, leave it valid
+    virtual void emit(LogLevel::T level, std::string &record) = 0;
+
+    // Rate limit check for a record from `location`; reports what the site dropped before it
+    bool admit(LogLevel::T level, const std::source_location &location);
+};
+
+struct LOG_CC_API AsyncLogger : public LoggerBase
+{
+    using Super = LoggerBase;
+    std::shared_ptr<AsyncLogControl> logCore;
+
+    AsyncLogger(std::shared_ptr<AsyncLogControl> logCore)
+        : LoggerBase()
+    {
+        this->logCore = logCore;
+    }
+
+    using LoggerBase::log; // structured records
+
+    void log(LogLevel::T level, std::string_view msg, std::source_location location = std::source_location::current())
+    {
+        if (!bEnabled(level)) {
+            return;
+        }
+        if (rateLimiter.bEnabled() && !admit(level, location)) {
+            return;
+        }
+        std::string output;
+        if (formatter(config, output, level, msg, location)) {
+            logCore->push(std::move(output), level);
+        }
+    }
+
+    // Only the format string and copies of the arguments are taken here,
+    // std::vformat and the formatter run on the worker thread.
+    //   logger.logDeferred(LogLevel::Info, "x={} y={}", x, y);
+    template <typename... Args>
+    void logDeferred(LogLevel::T level, FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args)
+    {
+        if (!bEnabled(level)) {
+            return;
+        }
+        if (rateLimiter.bEnabled() && !admit(level, fmt.location)) {
+            return;
+        }
+        logCore->push(MessageElem{
+            .level    = level,
+            .msg      = {},
+            .deferred = {
+                .fmt       = fmt.str,
+                .location  = fmt.location,
+                .config    = config,
+                .formatter = sharedFormatter,
+                .args      = DeferredArgs::capture(std::forward<Args>(args)...),
+            },
+        });
+    }
+
+    // LOG_CC_INFO(logger, ...) & co: only a pointer to the static CallSiteMeta and the
+    // arguments are queued; the worker formats, with the site's prefix rendered once
+    template <typename... Args>
+    void logSite(const CallSiteMeta &site, std::format_string<Args...> fmt, Args &&...args)
+    {
+        if (!bEnabled(site.level)) {
+            return;
+        }
+        if (rateLimiter.bEnabled() && !admit(site.level, site.location)) {
+            return;
+        }
+        (void)fmt; // checked at compile time, site.fmt is the same string
+        logCore->push(MessageElem{
+            .level    = site.level,
+            .msg      = {},
+            .deferred = {
+                .fmt        = site.fmt,
+                .location   = site.location,
+                .config     = config,
+                .formatter  = sharedFormatter,
+                .args       = DeferredArgs::capture(std::forward<Args>(args)...),
+                .sitePrefix = sitePrefixFormatter,
+            },
+            .site = &site,
+        });
+    }
+
+    // Like logDeferred(), but when the control writes a binary file (useBinaryFile()) the
+    // arguments are encoded as raw bytes and nothing is formatted in this process at all.
+    //   logger.logBinary(LogLevel::Info, "x={} y={}", x, y);
+    template <typename... Args>
+    void logBinary(LogLevel::T level, FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args)
+    {
+        if (!bEnabled(level)) {
+            return;
+        }
+        if (!logCore->binaryFile) {
+            logDeferred(level, fmt, std::forward<Args>(args)...);
+            return;
+        }
+        if (rateLimiter.bEnabled() && !admit(level, fmt.location)) {
+            return;
+        }
+        MessageElem elem{
+            .level      = level,
+            .binarySite = BinaryLog::callSiteId(fmt.str, fmt.location),
+        };
+        BinaryLog::encodeArgs(elem.msg, args...);
+        logCore->push(std::move(elem));
+    }
+
+  protected:
+    // The buffer itself goes to the queue, no copy; the thread continues with one the
+    // worker has written and handed back (BufferPool), a fresh one only while none is spare
+    void emit(LogLevel::T level, std::string &record) override
+    {
+        std::size_t size = record.size();
+        logCore->push(std::move(record), level);
+        record = logCore->bufferPool.take(size);
+    }
+};
+
+struct SyncLogger : public LoggerBase
+{
+    std::vector<FileAppender> fileAppenders;
+    DuplicateFilter           duplicateFilter;
+
+
+    LOG_CC_API SyncLogger()
+        : LoggerBase()
+    {
+    }
+
+    using LoggerBase::log; // structured records
+
+    ~SyncLogger() override
+    {
+        std::uint64_t repeats     = 0;
+        LogLevel::T   repeatLevel = LogLevel::Info;
+        if (duplicateFilter.takeRepeats(repeats, repeatLevel)) {
+            MessageElem elem = repeated(repeatLevel, repeats);
+            write(std::span<const MessageElem>(&elem, 1));
+        }
+    }
+
+    // waiting threads hold pointers into the CombiningWriter
+    SyncLogger(SyncLogger &&)                     = delete;
+    SyncLogger &operator=(SyncLogger &&)          = delete;
+    SyncLogger(const SyncLogger &)                = delete;
+    SyncLogger &operator=(const SyncLogger &)     = delete;
+
+    // Collapse consecutive identical records into one "last message repeated times=N" record
+    void setSuppressDuplicates(bool bSuppress)
+    {
+        duplicateFilter.bEnabled = bSuppress;
+    }
+
+    LOG_CC_API void log(LogLevel::T level, std::string_view msg, std::source_location location = std::source_location::current())
+    {
+#ifdef LOG_CC_PROFILE_ENABLE
+        using clock_t = std::chrono::steady_clock;
+        auto now      = clock_t::now();
+#endif
+        if (!bEnabled(level)) {
+            return;
+        }
+        if (rateLimiter.bEnabled() && !admit(level, location)) {
+            return;
+        }
+        std::string output;
+        formatter(config, output, level, msg, location);
+
+        emit(level, output);
+#ifdef LOG_CC_PROFILE_ENABLE
+        auto gap = clock_t::now();
+        auto ns  = std::chrono::duration_cast<std::chrono::nanoseconds>(gap - now).count();
+        printf("cost: %f ms(%lld ns)\n", (double)ns / 1000000.0, ns);
+#endif
+    }
+
+  protected:
+    // Whichever thread holds the writer writes its own record and those other threads
+    // published meanwhile, with one write per sink
+    void emit(LogLevel::T level, std::string &record) override
+    {
+        MessageElem elem{.level = level, .msg = std::move(record)};
+        writer.submit(elem, [this](std::span<MessageElem *const> records) {
+            writeCombined(records);
+        });
+        record = std::move(elem.msg); // give the capacity back to the caller's buffer
+    }
+
+    // runs on one thread at a time (CombiningWriter)
+    void writeCombined(std::span<MessageElem *const> records)
+    {
+        std::uint64_t repeats     = 0;
+        LogLevel::T   repeatLevel = LogLevel::Info;
+        combined.clear();
+        owners.clear();
+        for (MessageElem *elem : records) {
+            if (!duplicateFilter.pass(elem->level, elem->msg, repeats, repeatLevel)) {
+                continue;
+            }
+            if (repeats > 0) {
+                combined.push_back(repeated(repeatLevel, repeats));
+            }
+            // borrow the string, its owner waits until it is handed back below
+            owners.emplace_back(elem, combined.size());
+            combined.push_back(MessageElem{.level = elem->level, .msg = std::move(elem->msg)});
+        }
+        write(combined);
+        for (auto [elem, index] : owners) {
+            elem->msg = std::move(combined[index].msg);
+        }
+    }
+
+    // the record in place of `repeats` skipped duplicates, through this logger's formatter
+    MessageElem repeated(LogLevel::T level, std::uint64_t repeats)
+    {
+        Config own         = config;
+        own.logDetailLevel = Config::NoDetail; // the location would be this one
+        const Field fields[] = {{DuplicateFilter::RepeatField, repeats}};
+        MessageElem elem{.level = level};
+        formatFields(formatter, fieldEncoder, own, elem.msg, level, DuplicateFilter::RepeatMessage, fields, std::source_location::current());
+        return elem;
+    }
+
+    void write(std::span<const MessageElem> batch)
+    {
+        consoleAppender.write(batch);
+        for (auto &fileAppender : fileAppenders) {
+            fileAppender.write(batch);
+        }
+    }
+
+  private:
+    CombiningWriter<MessageElem>                       writer;
+    std::vector<MessageElem>                           combined; // writer only
+    std::vector<std::pair<MessageElem *, std::size_t>> owners;   // writer only: record, index in `combined`
 };
 
 
@@ -0,0 +1,137 @@
+#include "log_filter.h"
+
+#include <algorithm>
+#include <chrono>
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+void RateLimiter::setLimit(const RateLimit &limit)
+{
+    if (!limit.bEnabled()) {
+        state = nullptr;
+        return;
+    }
+    state              = std::make_shared<State>();
+    state->limit       = limit;
+    state->intervalNs  = limit.perSecond > 0 ? (std::int64_t)(1e9 / limit.perSecond) : 0;
+    state->toleranceNs = state->intervalNs * (std::int64_t)(std::max<std::uint32_t>(limit.burst, 1) - 1);
+}
+
+std::uint64_t RateLimiter::nextId()
+{
+    static std::atomic<std::uint64_t> counter{0};
+    return ++counter;
+}
+
+std::size_t RateLimiter::SiteKeyHash::operator()(const SiteKey &key) const
+{
+    std::size_t h = std::hash<const void *>{}(key.file);
+    return h ^ (((std::size_t)key.line << 16 | key.column) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+}
+
+RateLimiter::Site &RateLimiter::site(const std::shared_ptr<State> &state, const std::source_location &location)
+{
+    SiteKey key{location.file_name(), location.line(), location.column()};
+
+    // The sites this thread looked up, per limiter state. Keyed by id rather than address,
+    // a new state may reuse a destroyed one's memory; the entries of destroyed states are
+    // dropped whenever one is added.
+    struct LocalSites
+    {
+        std::weak_ptr<State>                             owner;
+        std::unordered_map<SiteKey, Site *, SiteKeyHash> sites;
+    };
+    thread_local std::unordered_map<std::uint64_t, LocalSites> cache;
+    thread_local std::uint64_t                                 lastId = 0;
+    thread_local LocalSites                                   *last   = nullptr;
+    if (lastId != state->id) {
+        auto it = cache.find(state->id);
+        if (it == cache.end()) {
+            std::erase_if(cache, [](const auto &entry) {
+                return entry.second.owner.expired();
+            });
+            it               = cache.try_emplace(state->id).first;
+            it->second.owner = state;
+        }
+        lastId = state->id;
+        last   = &it->second;
+    }
+
+    Site *&cached = last->sites[key];
+    if (!cached) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        Site *&shared = state->sites[key];
+        if (!shared) {
+            shared = &state->storage.emplace_back();
+        }
+        cached = shared;
+    }
+    return *cached;
+}
+
+bool RateLimiter::allow(const std::source_location &location, std::uint64_t &suppressed)
+{
+    const RateLimit &limit = state->limit;
+    Site            &s     = site(state, location);
+
+    bool bAllow = true;
+    if (limit.sampleEvery > 1) {
+        bAllow = s.seen.fetch_add(1, std::memory_order_relaxed) % limit.sampleEvery == 0;
+    }
+    std::int64_t intervalNs  = state->intervalNs;
+    std::int64_t toleranceNs = state->toleranceNs;
+    if (bAllow && intervalNs > 0) {
+        std::int64_t now     = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        std::int64_t arrival = s.arrival.load(std::memory_order_relaxed);
+        for (;;) {
+            if (now < arrival - toleranceNs) {
+                bAllow = false;
+                break;
+            }
+            if (s.arrival.compare_exchange_weak(arrival, std::max(arrival, now) + intervalNs, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+    }
+
+    if (!bAllow) {
+        s.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressed = s.suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+
+
+bool DuplicateFilter::pass(LogLevel::T level, std::string_view record, std::uint64_t &repeats, LogLevel::T &repeatLevel)
+{
+    repeats = 0;
+    if (!bEnabled) {
+        return true;
+    }
+    if (level == lastLevel && record == last) {
+        ++this->repeats;
+        return false;
+    }
+    takeRepeats(repeats, repeatLevel);
+    last.assign(record);
+    lastLevel = level;
+    return true;
+}
+
+bool DuplicateFilter::takeRepeats(std::uint64_t &repeats, LogLevel::T &repeatLevel)
+{
+    if (this->repeats == 0) {
+        return false;
+    }
+    repeats       = this->repeats;
+    repeatLevel   = lastLevel;
+    this->repeats = 0;
+    return true;
+}
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <source_location>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "base.h"
+#include "log_level.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+// Limits applied to every call site of a logger separately, see LoggerBase::setRateLimit()
+struct RateLimit
+{
+    double        perSecond   = 0; // token bucket refill rate, 0 = no rate limit
+    std::uint32_t burst       = 1; // records a site may log at once before the rate applies
+    std::uint32_t sampleEvery = 0; // keep only every Nth record of a site, 0/1 = all
+
+    bool bEnabled() const { return perSecond > 0 || sampleEvery > 1; }
+};
+
+// Per call site (std::source_location) token bucket and sampling.
+// The bucket is one atomic "theoretical arrival time" per site (GCRA), so checking
+// a record takes no lock; the site lookup is cached per thread.
+// Copies share the limit and the buckets; setLimit() starts over with fresh ones.
+struct LOG_CC_API RateLimiter
+{
+    // Set before the first record is logged
+    void setLimit(const RateLimit &limit);
+
+    bool bEnabled() const { return state != nullptr; }
+
+    // Whether a record from `location` may be logged. When it may, `suppressed` receives
+    // the number of records this site dropped since its previous accepted one.
+    bool allow(const std::source_location &location, std::uint64_t &suppressed);
+
+  private:
+    struct Site
+    {
+        std::atomic<std::int64_t>  arrival{0}; // steady ns at which the bucket is full again
+        std::atomic<std::uint64_t> seen{0};
+        std::atomic<std::uint64_t> suppressed{0};
+    };
+
+    struct SiteKey
+    {
+        const char   *file;
+        std::uint32_t line;
+        std::uint32_t column;
+
+        bool operator==(const SiteKey &) const = default;
+    };
+
+    struct SiteKeyHash
+    {
+        std::size_t operator()(const SiteKey &key) const;
+    };
+
+    // Everything one setLimit() call set up
+    struct State
+    {
+        RateLimit    limit;
+        std::int64_t intervalNs  = 0;
+        std::int64_t toleranceNs = 0;
+
+        std::mutex                                       mutex; // guards `sites`
+        std::unordered_map<SiteKey, Site *, SiteKeyHash> sites;
+        std::deque<Site>                                 storage;
+        const std::uint64_t                              id = nextId();
+    };
+
+    static Site &site(const std::shared_ptr<State> &state, const std::source_location &location);
+
+    std::shared_ptr<State> state; // null while no limit is set
+
+    static std::uint64_t nextId();
+};
+
+
+// Collapses consecutive identical records; the caller writes a RepeatMessage record with
+// the count in its place ("last message repeated times=N", or as JSON fields).
+// Not thread safe: used where records are already serialised (the async worker, SyncLogger).
+struct LOG_CC_API DuplicateFilter
+{
+    static constexpr std::string_view RepeatMessage = "last message repeated";
+    static constexpr std::string_view RepeatField   = "times";
+
+    bool bEnabled = false;
+
+    // false when `record` repeats the previous record and is to be skipped; otherwise
+    // `repeats` receives the number of records skipped before it (0 if none), to be
+    // reported at `repeatLevel`
+    bool pass(LogLevel::T level, std::string_view record, std::uint64_t &repeats, LogLevel::T &repeatLevel);
+
+    // The records skipped so far, if any, e.g. when output goes idle
+    bool takeRepeats(std::uint64_t &repeats, LogLevel::T &repeatLevel);
+
+  private:
+    std::string   last;
+    LogLevel::T   lastLevel = LogLevel::Info;
+    std::uint64_t repeats   = 0;
+};
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -40,6 +42,26 @@ enum ETerminalColor
     ColorCount,
 };
 
+// Constexpr tables indexed by toIndex(level), for the per-record paths
+inline constexpr std::size_t Count = 6;
+
+constexpr std::size_t toIndex(LogLevel::T level)
+{
+    return (std::size_t)level / 100 - 1;
+}
+
+// One of Debug..Fatal, e.g. for a level read from a file before it indexes the tables
+constexpr bool isValid(std::uint32_t level)
+{
+    return level >= Debug && level <= Fatal && level % 100 == 0;
+}
+
+inline constexpr std::string_view levelStrings[Count]            = {"DEBUG", "TRACE", "Info", "WARN", "ERROR", "FATAL"};
+inline constexpr std::string_view levelCompatStrings[Count]      = {"D", "T", "I", "W", "E", "F"};
+inline constexpr std::string_view levelTerminalColorCodes[Count] = {"\033[36m", "\033[37m", "\033[32m", "\033[33m", "\033[31m", "\033[31m"};
+inline constexpr std::string_view resetTerminalColorCode         = "\033[0m";
+
+
 LOG_CC_API extern const std::unordered_map<LogLevel::T, std::string>    level2Strings;            // LogLevel::Debug -> "DEBUG"
 LOG_CC_API extern const std::unordered_map<LogLevel::T, std::string>    level2CompatLevelStrings; // LogLevel::Debug -> "D"
 LOG_CC_API extern const std::unordered_map<ETerminalColor, std::string> color2TerminalColorCode;  // ETerminalColor::Reset -> "\033[0m"
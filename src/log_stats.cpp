@@ -0,0 +1,46 @@
+#include "log_stats.h"
+
+#include <format>
+#include <iterator>
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+std::uint64_t AsyncLogStats::droppedTotal() const
+{
+    std::uint64_t total = 0;
+    for (std::uint64_t count : dropped) {
+        total += count;
+    }
+    return total;
+}
+
+std::string AsyncLogStats::toString() const
+{
+    std::string ret;
+    auto        out = std::back_inserter(ret);
+    std::format_to(out, "pushed {} dequeued {} dropped {} depth {} high-water {} batches {} enqueue avg {}ns max {}ns worker busy {}ms idle {}ms",
+                   pushed, dequeued, droppedTotal(), queueDepth, queueHighWater, batches,
+                   pushed > 0 ? enqueueNs / pushed : 0, enqueueMaxNs,
+                   workerBusyNs / 1000000, workerIdleNs / 1000000);
+    if (!sinks.empty()) {
+        ret += "; ";
+        ret += sinksToString();
+    }
+    return ret;
+}
+
+std::string AsyncLogStats::sinksToString() const
+{
+    std::string ret;
+    auto        out = std::back_inserter(ret);
+    for (const SinkStats &sink : sinks) {
+        std::format_to(out, "{}{}: {} records {} bytes write {}ms flushes {} ({}ms)", ret.empty() ? "" : "; ",
+                       sink.name, sink.records, sink.bytes, sink.writeNs / 1000000, sink.flushes, sink.flushNs / 1000000);
+    }
+    return ret;
+}
+
+
+TOP_LEVEL_NAMESPACE_END
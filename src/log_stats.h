@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "base.h"
+#include "log_level.h"
+#include "ring_queue.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+struct SinkStats
+{
+    std::string   name;
+    std::uint64_t records = 0;
+    std::uint64_t bytes   = 0;
+    std::uint64_t writeNs = 0;
+    std::uint64_t flushes = 0; // flushes requested by the pipeline
+    std::uint64_t flushNs = 0;
+};
+
+// Snapshot of AsyncLogControl::stats()
+struct LOG_CC_API AsyncLogStats
+{
+    std::uint64_t pushed         = 0; // records handed to push(), dropped ones included
+    std::uint64_t dequeued       = 0;
+    std::uint64_t batches        = 0;
+    std::uint64_t queueDepth     = 0; // pushed - dequeued - dropped, right now
+    std::uint64_t queueHighWater = 0; // largest backlog found by the worker in one drain
+    std::uint64_t enqueueNs      = 0; // total time producers spent in push()
+    std::uint64_t enqueueMaxNs   = 0;
+    std::uint64_t workerBusyNs   = 0;
+    std::uint64_t workerIdleNs   = 0; // waiting for records
+
+    std::array<std::uint64_t, LogLevel::Count> dropped{};
+    std::vector<SinkStats>                      sinks;
+
+    std::uint64_t droppedTotal() const;
+    // one line, e.g. for the periodic dump
+    std::string toString() const;
+    // the part of toString() after the pipeline counters: "name: N records ..." per sink
+    std::string sinksToString() const;
+};
+
+
+// Counters behind AsyncLogStats. Producers only touch their own stripe (relaxed),
+// so a shared cache line does not bounce between them on every push.
+struct PipelineCounters
+{
+    static constexpr std::size_t StripeCount = 16;
+
+    struct alignas(CacheLineSize) Stripe
+    {
+        std::atomic<std::uint64_t> pushed{0};
+        std::atomic<std::uint64_t> enqueueNs{0};
+        std::atomic<std::uint64_t> enqueueMaxNs{0};
+    };
+    Stripe stripes[StripeCount];
+
+    // worker only writers
+    alignas(CacheLineSize) std::atomic<std::uint64_t> dequeued{0};
+    std::atomic<std::uint64_t> batches{0};
+    std::atomic<std::uint64_t> highWater{0};
+    std::atomic<std::uint64_t> busyNs{0};
+    std::atomic<std::uint64_t> idleNs{0};
+
+    void recordPush(std::uint64_t ns)
+    {
+        Stripe &stripe = stripes[stripeIndex()];
+        stripe.pushed.fetch_add(1, std::memory_order_relaxed);
+        stripe.enqueueNs.fetch_add(ns, std::memory_order_relaxed);
+        if (ns > stripe.enqueueMaxNs.load(std::memory_order_relaxed)) {
+            stripe.enqueueMaxNs.store(ns, std::memory_order_relaxed); // a racing larger value may be lost
+        }
+    }
+
+    // A drain of `size` records; the backlog it found is what was pushed and not yet taken
+    // or dropped, the batch included (the rings hand out at most a batch at a time)
+    void recordBatch(std::size_t size, std::uint64_t droppedTotal)
+    {
+        std::uint64_t gone  = dequeued.load(std::memory_order_relaxed) + droppedTotal;
+        std::uint64_t in    = pushedTotal();
+        std::uint64_t depth = std::max<std::uint64_t>(in > gone ? in - gone : 0, size);
+        if (depth > highWater.load(std::memory_order_relaxed)) {
+            highWater.store(depth, std::memory_order_relaxed);
+        }
+        dequeued.fetch_add(size, std::memory_order_relaxed);
+        batches.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t pushedTotal() const
+    {
+        std::uint64_t ret = 0;
+        for (const Stripe &stripe : stripes) {
+            ret += stripe.pushed.load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    static std::size_t stripeIndex()
+    {
+        static std::atomic<std::size_t> counter{0};
+        thread_local std::size_t        index = counter.fetch_add(1, std::memory_order_relaxed) % StripeCount;
+        return index;
+    }
+};
+
+// Written by the thread driving the sink, read by stats()
+struct SinkCounters
+{
+    std::string                name;
+    std::atomic<std::uint64_t> records{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> writeNs{0};
+    std::atomic<std::uint64_t> flushes{0};
+    std::atomic<std::uint64_t> flushNs{0};
+
+    explicit SinkCounters(std::string name)
+        : name(std::move(name))
+    {
+    }
+
+    void addWrite(std::size_t count, std::size_t size, std::uint64_t ns)
+    {
+        records.fetch_add(count, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        writeNs.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    void addFlush(std::uint64_t ns)
+    {
+        flushes.fetch_add(1, std::memory_order_relaxed);
+        flushNs.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    SinkStats snapshot() const
+    {
+        return SinkStats{
+            .name    = name,
+            .records = records.load(std::memory_order_relaxed),
+            .bytes   = bytes.load(std::memory_order_relaxed),
+            .writeNs = writeNs.load(std::memory_order_relaxed),
+            .flushes = flushes.load(std::memory_order_relaxed),
+            .flushNs = flushNs.load(std::memory_order_relaxed),
+        };
+    }
+};
+
+// Nanoseconds from `start` to `end`
+inline std::uint64_t elapsedNs(std::chrono::steady_clock::time_point start,
+                               std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now())
+{
+    return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,190 @@
+#include "mmap_file_appender.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+#ifdef _WIN32
+
+MmapFileAppender::MmapFileAppender(std::string_view filename, std::size_t windowSize)
+    : filename(filename), fallback(filename, FlushPolicy{.bufferSize = windowSize})
+{
+}
+
+MmapFileAppender::~MmapFileAppender() = default;
+
+bool MmapFileAppender::isOpen() const
+{
+    return fallback.isOpen();
+}
+
+void MmapFileAppender::write(std::span<const MessageElem> batch)
+{
+    fallback.write(batch);
+}
+
+void MmapFileAppender::flush()
+{
+    fallback.flush();
+}
+
+#else
+
+// Extend the file's allocation to cover [offset, offset + size)
+static bool preallocate(int fd, std::uint64_t offset, std::size_t size)
+{
+    #if defined(__linux__)
+    if (::fallocate(fd, 0, (off_t)offset, (off_t)size) == 0) {
+        return true;
+    }
+    #elif !defined(__APPLE__)
+    if (::posix_fallocate(fd, (off_t)offset, (off_t)size) == 0) {
+        return true;
+    }
+    #endif
+    // filesystem without fallocate support: a sparse extension still lets us map it
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        return false;
+    }
+    if ((std::uint64_t)st.st_size >= offset + size) {
+        return true;
+    }
+    return ::ftruncate(fd, (off_t)(offset + size)) == 0;
+}
+
+// Length of the file without the zero padding a crashed writer left behind
+// (the destructor's ftruncate never ran); log text has no NUL bytes of its own
+static std::uint64_t logicalLength(int fd, std::uint64_t size)
+{
+    char buffer[64 << 10];
+    while (size > 0) {
+        std::size_t n    = (std::size_t)std::min<std::uint64_t>(size, sizeof(buffer));
+        ssize_t     read = ::pread(fd, buffer, n, (off_t)(size - n));
+        if (read != (ssize_t)n) {
+            return size; // keep what we cannot check
+        }
+        for (std::size_t i = n; i > 0; --i, --size) {
+            if (buffer[i - 1] != '\0') {
+                return size;
+            }
+        }
+    }
+    return 0;
+}
+
+
+MmapFileAppender::MmapFileAppender(std::string_view filename, std::size_t windowSize)
+    : filename(filename)
+{
+    std::size_t pageSize = (std::size_t)::sysconf(_SC_PAGESIZE);
+    // round up to whole pages, windows are mapped at multiples of their size
+    this->windowSize = (windowSize + pageSize - 1) / pageSize * pageSize;
+    if (this->windowSize == 0) {
+        this->windowSize = pageSize;
+    }
+
+    fd = ::open(this->filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        debug("log.cc::MmapFileAppender"), "failed to open", this->filename;
+        return;
+    }
+    struct stat st{};
+    ::fstat(fd, &st);
+    fileEnd = logicalLength(fd, (std::uint64_t)st.st_size);
+
+    if (!mapWindow(fileEnd / this->windowSize * this->windowSize)) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+MmapFileAppender::~MmapFileAppender()
+{
+    if (fd < 0) {
+        return;
+    }
+    unmapWindow();
+    // drop the preallocated tail
+    if (::ftruncate(fd, (off_t)fileEnd) != 0) {
+        debug("log.cc::MmapFileAppender"), "failed to truncate", filename;
+    }
+    ::close(fd);
+}
+
+bool MmapFileAppender::isOpen() const
+{
+    return fd >= 0;
+}
+
+bool MmapFileAppender::mapWindow(std::uint64_t offset)
+{
+    if (!preallocate(fd, offset, windowSize)) {
+        debug("log.cc::MmapFileAppender"), "failed to preallocate", filename;
+        return false;
+    }
+    void *addr = ::mmap(nullptr, windowSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)offset);
+    if (addr == MAP_FAILED) {
+        debug("log.cc::MmapFileAppender"), "mmap failed", filename;
+        return false;
+    }
+    window    = (char *)addr;
+    mapOffset = offset;
+    return true;
+}
+
+void MmapFileAppender::unmapWindow()
+{
+    if (window) {
+        ::munmap(window, windowSize);
+        window = nullptr;
+    }
+}
+
+void MmapFileAppender::append(const char *data, std::size_t size)
+{
+    while (size > 0 && window) {
+        std::size_t pos = (std::size_t)(fileEnd - mapOffset);
+        if (pos == windowSize) {
+            unmapWindow();
+            if (!mapWindow(mapOffset + windowSize)) {
+                return;
+            }
+            pos = 0;
+        }
+        std::size_t n = std::min(size, windowSize - pos);
+        std::memcpy(window + pos, data, n);
+        fileEnd += n;
+        data += n;
+        size -= n;
+    }
+}
+
+void MmapFileAppender::write(std::span<const MessageElem> batch)
+{
+    for (const MessageElem &elem : batch) {
+        append(elem.msg.data(), elem.msg.size());
+    }
+}
+
+void MmapFileAppender::flush()
+{
+    if (window) {
+        ::msync(window, windowSize, MS_ASYNC);
+    }
+}
+
+#endif
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "base.h"
+#include "log.h"
+#include "raw_file_appender.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+// File appender that writes through a shared mmap window over extents preallocated
+// with fallocate: appending a record is a memcpy, with no syscall per batch.
+// The window slides forward as it fills, and the file is truncated to its real length
+// on close. Whatever was copied lives in the page cache, so it reaches the disk even
+// if the process dies afterwards (the file then ends with zero padding up to the window end,
+// which the next MmapFileAppender on the file writes over).
+//   logCore->addAppender<MmapFileAppender>("app.log");
+// Windows: falls back to buffered writes through RawFileAppender.
+struct LOG_CC_API MmapFileAppender
+{
+    std::string filename;
+
+    MmapFileAppender(std::string_view filename, std::size_t windowSize = 16 << 20);
+    ~MmapFileAppender();
+
+    MmapFileAppender(const MmapFileAppender &)            = delete;
+    MmapFileAppender &operator=(const MmapFileAppender &) = delete;
+
+    bool isOpen() const;
+
+    void operator<<(const MessageElem &elem) { write(std::span<const MessageElem>(&elem, 1)); }
+
+    void write(std::span<const MessageElem> batch);
+    // starts write-back of the dirty pages (msync MS_ASYNC), never blocks on the disk
+    void flush();
+
+  private:
+#ifdef _WIN32
+    RawFileAppender fallback;
+#else
+    bool mapWindow(std::uint64_t offset);
+    void unmapWindow();
+    void append(const char *data, std::size_t size);
+
+    int           fd         = -1;
+    std::size_t   windowSize = 0;
+    char         *window     = nullptr;
+    std::uint64_t mapOffset  = 0; // file offset of window[0]
+    std::uint64_t fileEnd    = 0; // logical length of the file
+#endif
+};
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <source_location>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "base.h"
+#include "log_level.h"
+#include "timestamp.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+struct Config;
+
+
+// String literal usable as a template argument: PatternFormatter<"[%l] %v">
+template <std::size_t N>
+struct FixedString
+{
+    char data[N]{};
+
+    constexpr FixedString(const char (&str)[N])
+    {
+        std::copy_n(str, N, data);
+    }
+
+    constexpr std::string_view view() const { return {data, N - 1}; }
+};
+
+
+namespace Pattern
+{
+
+enum class EField : unsigned char
+{
+    Literal,
+    Message,    // %v
+    Level,      // %l  DEBUG / Info / WARN ...
+    LevelShort, // %L  D / I / W ...
+    Name,       // %n  PatternFormatter::name
+    File,       // %s
+    Line,       // %#
+    Function,   // %!
+    Time,       // %T  2024-01-02 03:04:05.123456
+    ColorStart, // %^  level color
+    ColorEnd,   // %$  reset color
+};
+
+struct Token
+{
+    EField      field = EField::Literal;
+    std::size_t begin = 0; // literal text range in the pattern
+    std::size_t size  = 0;
+};
+
+constexpr EField toField(char c)
+{
+    switch (c) {
+    case 'v':
+        return EField::Message;
+    case 'l':
+        return EField::Level;
+    case 'L':
+        return EField::LevelShort;
+    case 'n':
+        return EField::Name;
+    case 's':
+        return EField::File;
+    case '#':
+        return EField::Line;
+    case '!':
+        return EField::Function;
+    case 'T':
+        return EField::Time;
+    case '^':
+        return EField::ColorStart;
+    case '$':
+        return EField::ColorEnd;
+    }
+    throw "log.cc: unknown pattern flag"; // only ever evaluated at compile time: a compile error
+}
+
+// Adjacent literal characters (and "%%") are merged into one token.
+// With `out == nullptr` only counts.
+constexpr std::size_t parse(std::string_view pattern, Token *out)
+{
+    std::size_t count    = 0;
+    bool        bLiteral = false;
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] == '%') {
+            if (i + 1 >= pattern.size()) {
+                throw "log.cc: dangling '%' at the end of the pattern";
+            }
+            ++i;
+            if (pattern[i] == '%') {
+                // start a new literal at the second '%'
+                if (out) {
+                    out[count] = {EField::Literal, i, 1};
+                }
+                ++count;
+                bLiteral = true;
+                continue;
+            }
+            if (out) {
+                out[count] = {toField(pattern[i]), 0, 0};
+            }
+            ++count;
+            bLiteral = false;
+        }
+        else if (bLiteral) {
+            if (out) {
+                ++out[count - 1].size;
+            }
+        }
+        else {
+            if (out) {
+                out[count] = {EField::Literal, i, 1};
+            }
+            ++count;
+            bLiteral = true;
+        }
+    }
+    return count;
+}
+
+template <FixedString P>
+struct Parsed
+{
+    static constexpr std::size_t count = parse(P.view(), nullptr);
+
+    static constexpr std::array<Token, count> tokens = []() {
+        std::array<Token, count> ret{};
+        parse(P.view(), ret.data());
+        return ret;
+    }();
+
+    static constexpr std::size_t messageCount = std::count_if(tokens.begin(), tokens.end(), [](const Token &t) {
+        return t.field == EField::Message;
+    });
+    // the record is prefix + message + '\n', so the typed API can append the message itself
+    static constexpr bool bMessageLast = count > 0 && tokens[count - 1].field == EField::Message && messageCount == 1;
+};
+
+} // namespace Pattern
+
+
+// Formatter whose layout is parsed at compile time into a fixed sequence of field emitters:
+//   logger.setFormatter(PatternFormatter<"%T [%l] %n %s:%# %v">{.name = "net"});
+// Every field appends straight into the output, nothing allocates once the buffer is warm.
+// %T is the time of the log call, also for records formatted later by the async worker.
+// A '\n' is appended after the last field.
+template <FixedString P>
+struct PatternFormatter
+{
+    using parsed_t = Pattern::Parsed<P>;
+    static_assert(parsed_t::messageCount <= 1, "log.cc: %v may appear only once in a pattern");
+
+    std::string name;
+
+    bool operator()(const Config &, std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location) const
+    {
+        output.clear();
+        emit(output, level, msg, location, std::make_index_sequence<parsed_t::count>{});
+        output.push_back('\n');
+        return true;
+    }
+
+    void appendPrefix(const Config &, std::string &output, LogLevel::T level, const std::source_location &location) const
+        requires(parsed_t::bMessageLast)
+    {
+        emit(output, level, {}, location, std::make_index_sequence<parsed_t::count - 1>{});
+    }
+
+  private:
+    template <std::size_t... I>
+    void emit(std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location, std::index_sequence<I...>) const
+    {
+        (emitField<parsed_t::tokens[I]>(output, level, msg, location), ...);
+    }
+
+    template <Pattern::Token T>
+    void emitField(std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location) const
+    {
+        using Pattern::EField;
+        if constexpr (T.field == EField::Literal) {
+            output.append(P.data + T.begin, T.size);
+        }
+        else if constexpr (T.field == EField::Message) {
+            output.append(msg);
+        }
+        else if constexpr (T.field == EField::Level) {
+            output.append(LogLevel::levelStrings[LogLevel::toIndex(level)]);
+        }
+        else if constexpr (T.field == EField::LevelShort) {
+            output.append(LogLevel::levelCompatStrings[LogLevel::toIndex(level)]);
+        }
+        else if constexpr (T.field == EField::Name) {
+            output.append(name);
+        }
+        else if constexpr (T.field == EField::File) {
+            output.append(location.file_name());
+        }
+        else if constexpr (T.field == EField::Line) {
+            char buf[16];
+            auto ret = std::to_chars(buf, buf + sizeof(buf), location.line());
+            output.append(buf, ret.ptr);
+        }
+        else if constexpr (T.field == EField::Function) {
+            output.append(location.function_name());
+        }
+        else if constexpr (T.field == EField::Time) {
+            appendCurrentTimestamp(output, ETimePrecision::Micro);
+        }
+        else if constexpr (T.field == EField::ColorStart) {
+            output.append(LogLevel::levelTerminalColorCodes[LogLevel::toIndex(level)]);
+        }
+        else if constexpr (T.field == EField::ColorEnd) {
+            output.append(LogLevel::resetTerminalColorCode);
+        }
+    }
+};
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,175 @@
+#include "raw_file_appender.h"
+
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+static int openAppend(const std::string &filename)
+{
+#ifdef _WIN32
+    return ::_open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+}
+
+static void syncData(int fd)
+{
+#ifdef _WIN32
+    ::_commit(fd);
+#elif defined(__APPLE__)
+    ::fsync(fd);
+#else
+    ::fdatasync(fd);
+#endif
+}
+
+
+RawFileAppender::RawFileAppender(std::string_view filename, FlushPolicy policy)
+    : filename(filename), policy(policy)
+{
+    if (this->policy.bufferSize == 0) {
+        this->policy.bufferSize = 1;
+    }
+    buffer    = std::make_unique<char[]>(this->policy.bufferSize);
+    lastFlush = std::chrono::steady_clock::now();
+    fd        = openAppend(this->filename);
+    if (fd < 0) {
+        debug("log.cc::RawFileAppender"), "failed to open", this->filename;
+    }
+}
+
+RawFileAppender::~RawFileAppender()
+{
+    close();
+}
+
+RawFileAppender::RawFileAppender(RawFileAppender &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+RawFileAppender &RawFileAppender::operator=(RawFileAppender &&other) noexcept
+{
+    if (this != &other) {
+        close();
+        filename       = std::move(other.filename);
+        policy         = other.policy;
+        fd             = std::exchange(other.fd, -1);
+        buffer         = std::move(other.buffer);
+        used           = std::exchange(other.used, 0);
+        pendingRecords = std::exchange(other.pendingRecords, 0);
+        lastFlush      = other.lastFlush;
+    }
+    return *this;
+}
+
+void RawFileAppender::close()
+{
+    if (fd >= 0) {
+        flush();
+#ifdef _WIN32
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+}
+
+void RawFileAppender::write(std::span<const MessageElem> batch)
+{
+    if (fd < 0) {
+        return;
+    }
+    bool bFlushLevel = false;
+    for (const MessageElem &elem : batch) {
+        append(elem.msg);
+        bFlushLevel |= elem.level >= policy.flushLevel;
+    }
+    pendingRecords += batch.size();
+
+    if (bFlushLevel ||
+        (policy.flushBytes && used >= policy.flushBytes) ||
+        (policy.flushRecords && pendingRecords >= policy.flushRecords))
+    {
+        flush();
+    }
+    else {
+        poll();
+    }
+}
+
+void RawFileAppender::poll()
+{
+    if (used == 0 || policy.flushInterval.count() == 0) {
+        return;
+    }
+    if (std::chrono::steady_clock::now() - lastFlush >= policy.flushInterval) {
+        flush();
+    }
+}
+
+void RawFileAppender::flush()
+{
+    lastFlush = std::chrono::steady_clock::now();
+    if (fd < 0 || used == 0) {
+        return;
+    }
+    writeAll(buffer.get(), used);
+    used           = 0;
+    pendingRecords = 0;
+    if (policy.bSync) {
+        syncData(fd);
+    }
+}
+
+void RawFileAppender::append(std::string_view msg)
+{
+    if (used + msg.size() > policy.bufferSize) {
+        writeAll(buffer.get(), used);
+        used = 0;
+        if (msg.size() >= policy.bufferSize) {
+            // would not fit anyway, skip the copy
+            writeAll(msg.data(), msg.size());
+            return;
+        }
+    }
+    std::memcpy(buffer.get() + used, msg.data(), msg.size());
+    used += msg.size();
+}
+
+void RawFileAppender::writeAll(const char *data, std::size_t size)
+{
+    while (size > 0) {
+#ifdef _WIN32
+        int n = ::_write(fd, data, (unsigned int)size);
+#else
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if (n <= 0) {
+            debug("log.cc::RawFileAppender"), "write failed", filename;
+            return;
+        }
+        data += n;
+        size -= (std::size_t)n;
+    }
+}
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "base.h"
+#include "log.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+// When RawFileAppender hands its buffer to the kernel; every enabled trigger is checked
+// after each record / batch, a zero disables that trigger.
+struct FlushPolicy
+{
+    std::size_t               bufferSize    = 1 << 20; // user-space buffer, also flushed whenever full
+    std::size_t               flushBytes    = 0;       // flush once this many bytes are buffered
+    std::size_t               flushRecords  = 0;       // flush once this many records are buffered
+    std::chrono::milliseconds flushInterval = std::chrono::milliseconds(1000);
+    LogLevel::T               flushLevel    = LogLevel::Error; // flush right after a record at or above
+    bool                      bSync         = false;           // fdatasync() after every flush
+};
+
+
+// File appender on a raw O_APPEND file descriptor with a large user-space buffer,
+// for when std::ofstream's small buffer and fixed flushing are the bottleneck:
+//   logCore->addAppender<RawFileAppender>("app.log", FlushPolicy{.bufferSize = 4 << 20});
+struct LOG_CC_API RawFileAppender
+{
+    std::string filename;
+    FlushPolicy policy;
+
+    RawFileAppender() = default;
+    RawFileAppender(std::string_view filename, FlushPolicy policy = {});
+    ~RawFileAppender();
+
+    RawFileAppender(RawFileAppender &&other) noexcept;
+    RawFileAppender &operator=(RawFileAppender &&other) noexcept;
+
+    RawFileAppender(const RawFileAppender &)            = delete;
+    RawFileAppender &operator=(const RawFileAppender &) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+
+    void operator()(const MessageElem &elem) { write(std::span<const MessageElem>(&elem, 1)); }
+    void operator<<(const MessageElem &elem) { write(std::span<const MessageElem>(&elem, 1)); }
+
+    void write(std::span<const MessageElem> batch);
+    void flush();
+    // time based flush, called periodically by the AsyncLogControl worker
+    void poll();
+
+  private:
+    void append(std::string_view msg);
+    void writeAll(const char *data, std::size_t size);
+    void close();
+
+    int                                   fd = -1;
+    std::unique_ptr<char[]>               buffer;
+    std::size_t                           used           = 0;
+    std::size_t                           pendingRecords = 0;
+    std::chrono::steady_clock::time_point lastFlush;
+};
+
+
+TOP_LEVEL_NAMESPACE_END
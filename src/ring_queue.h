@@ -0,0 +1,443 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base.h"
+#include "worker_thread.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+inline constexpr std::size_t CacheLineSize = 64;
+
+
+// Bounded lock-free multi-producer / single-consumer ring.
+// Every slot carries a sequence number (Vyukov style): producers claim a
+// position with one CAS on `tail`, fill the slot and publish it by bumping its
+// sequence; the single consumer owns `head` and never touches `tail`.
+// Capacity is rounded up to a power of two, all slots are allocated up front.
+template <typename T>
+struct MpscRingQueue
+{
+    struct alignas(CacheLineSize) Slot
+    {
+        std::atomic<std::size_t> sequence;
+        T                        value;
+    };
+
+    MpscRingQueue(std::size_t capacity = 8192)
+    {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask  = size - 1;
+        slots = std::make_unique<Slot[]>(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRingQueue(const MpscRingQueue &)            = delete;
+    MpscRingQueue &operator=(const MpscRingQueue &) = delete;
+
+    std::size_t capacity() const { return mask + 1; }
+
+    // `value` is only moved from when true is returned
+    bool tryPush(T &&value)
+    {
+        std::size_t pos = tail.load(std::memory_order_relaxed);
+        Slot       *slot;
+        for (;;) {
+            slot               = &slots[pos & mask];
+            std::size_t    seq = slot->sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false; // full
+            }
+            else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::move(value);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        parker.wake();
+        return true;
+    }
+
+    // consumer only
+    bool tryPop(T &value)
+    {
+        Slot       &slot = slots[head & mask];
+        std::size_t seq  = slot.sequence.load(std::memory_order_acquire);
+        if (seq != head + 1) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+    // Blocks (spin then yield) while the ring is full.
+    void push(T &&value)
+    {
+        for (int spin = 0; !tryPush(std::move(value)); ++spin) {
+            if (spin > 64) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // consumer only
+    bool bReadable() const
+    {
+        return slots[head & mask].sequence.load(std::memory_order_acquire) == head + 1;
+    }
+
+    // Waits for an element following `wait`, then parks; returns false once shut down
+    // and drained, or when nothing arrived before `deadline`.
+    bool pop(T &value, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max())
+    {
+        auto bReady = [this]() {
+            return bReadable() || bShutdown.load(std::memory_order_acquire);
+        };
+        for (;;) {
+            if (tryPop(value)) {
+                return true;
+            }
+            if (bShutdown.load(std::memory_order_acquire)) {
+                // producers may have published right before the flag
+                return tryPop(value);
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            if (!wait.poll(deadline, bReady)) {
+                parker.park(deadline, bReady);
+            }
+        }
+    }
+
+    // Waits up to `timeout` for at least one element, then drains up to `maxBatch` into `batch`.
+    // Returns false only once shut down and drained.
+    bool popAll(std::vector<T> &batch, std::chrono::milliseconds timeout, std::size_t maxBatch = 4096)
+    {
+        batch.clear();
+        T value;
+        if (!pop(value, std::chrono::steady_clock::now() + timeout)) {
+            if (!bShutdown.load(std::memory_order_acquire)) {
+                return true; // timed out
+            }
+            if (!tryPop(value)) {
+                return false;
+            }
+        }
+        batch.emplace_back(std::move(value));
+        while (batch.size() < maxBatch && tryPop(value)) {
+            batch.emplace_back(std::move(value));
+        }
+        return true;
+    }
+
+    void shutdown()
+    {
+        bShutdown.store(true, std::memory_order_release);
+        parker.wakeAll();
+    }
+
+    WaitStrategy wait; // set before the consumer starts
+
+  private:
+    std::unique_ptr<Slot[]> slots;
+    std::size_t             mask = 0;
+
+    alignas(CacheLineSize) std::atomic<std::size_t> tail{0}; // shared by producers
+    alignas(CacheLineSize) std::size_t head = 0;             // consumer only
+    alignas(CacheLineSize) std::atomic<bool> bShutdown{false};
+    Parker parker;
+};
+
+
+
+// Bounded single-producer / single-consumer ring. Each side only writes its own
+// index and keeps a cached copy of the other one, so the hot path usually
+// touches no cache line owned by the other thread.
+template <typename T>
+struct SpscRingQueue
+{
+    SpscRingQueue(std::size_t capacity = 1024)
+    {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask  = size - 1;
+        slots = std::make_unique<T[]>(size);
+    }
+
+    SpscRingQueue(const SpscRingQueue &)            = delete;
+    SpscRingQueue &operator=(const SpscRingQueue &) = delete;
+
+    std::size_t capacity() const { return mask + 1; }
+
+    // producer only, `value` is only moved from when true is returned
+    bool tryPush(T &&value)
+    {
+        std::size_t pos = tail.load(std::memory_order_relaxed);
+        if (pos - headCache > mask) {
+            headCache = head.load(std::memory_order_acquire);
+            if (pos - headCache > mask) {
+                return false; // full
+            }
+        }
+        slots[pos & mask] = std::move(value);
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only
+    bool tryPop(T &value)
+    {
+        std::size_t pos = head.load(std::memory_order_relaxed);
+        if (pos == tailCache) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (pos == tailCache) {
+                return false;
+            }
+        }
+        value = std::move(slots[pos & mask]);
+        head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+  private:
+    std::unique_ptr<T[]> slots;
+    std::size_t          mask = 0;
+
+    alignas(CacheLineSize) std::atomic<std::size_t> tail{0};
+    std::size_t headCache = 0; // producer's view of head
+    alignas(CacheLineSize) std::atomic<std::size_t> head{0};
+    std::size_t tailCache = 0; // consumer's view of tail
+};
+
+
+// One SpscRingQueue per producing thread, created lazily on the thread's first
+// push; the single consumer polls all of them round-robin.
+// The registry mutex is only taken when a thread registers and when the consumer
+// refreshes its list, never on the producer hot path.
+template <typename T>
+struct ThreadQueueSet
+{
+    using ring_t = SpscRingQueue<T>;
+
+    ThreadQueueSet(std::size_t capacityPerThread = 1024)
+        : capacityPerThread(capacityPerThread)
+    {
+    }
+
+    ThreadQueueSet(const ThreadQueueSet &)            = delete;
+    ThreadQueueSet &operator=(const ThreadQueueSet &) = delete;
+
+    // `value` is only moved from when true is returned
+    bool tryPush(T &&value)
+    {
+        if (!local().tryPush(std::move(value))) {
+            return false;
+        }
+        parker.wake();
+        return true;
+    }
+
+    // Blocks (spin then yield) while this thread's ring is full
+    void push(T &&value)
+    {
+        ring_t &ring = local();
+        for (int spin = 0; !ring.tryPush(std::move(value)); ++spin) {
+            if (spin > 64) {
+                std::this_thread::yield();
+            }
+        }
+        parker.wake();
+    }
+
+    // Waits up to `timeout` for at least one element, then takes up to `maxBatch` from the
+    // rings, starting at a different ring every call. Returns false once shut down and drained.
+    bool popAll(std::vector<T> &batch, std::chrono::milliseconds timeout, std::size_t maxBatch = 4096)
+    {
+        batch.clear();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        auto bReady   = [this]() {
+            return bShutdown.load(std::memory_order_acquire) ||
+                   registered.load(std::memory_order_acquire) != snapshotVersion ||
+                   std::any_of(snapshot.begin(), snapshot.end(), [](const ring_t *ring) { return !ring->empty(); });
+        };
+        for (;;) {
+            bool bStop = bShutdown.load(std::memory_order_acquire);
+            if (registered.load(std::memory_order_acquire) != snapshotVersion) {
+                refresh();
+            }
+            drain(batch, maxBatch);
+            if (!batch.empty()) {
+                return true;
+            }
+            if (bStop) {
+                return false;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                refresh(); // lets go of the rings of exited threads
+                return true;
+            }
+            if (!wait.poll(deadline, bReady)) {
+                parker.park(deadline, bReady);
+            }
+        }
+    }
+
+    void shutdown()
+    {
+        bShutdown.store(true, std::memory_order_release);
+        parker.wakeAll();
+    }
+
+    WaitStrategy wait; // set before the consumer starts
+
+  private:
+    // A producer's ring. The set owns it, the thread only holds a weak reference, so the
+    // memory goes with the set even when the thread outlives it
+    struct Lane
+    {
+        ring_t            ring;
+        std::atomic<bool> bDetached{false}; // the producing thread has exited
+
+        explicit Lane(std::size_t capacity)
+            : ring(capacity)
+        {
+        }
+    };
+
+    // Thread side of a Lane, detaches it when the thread exits
+    struct LaneRef
+    {
+        std::weak_ptr<Lane> lane;
+
+        explicit LaneRef(std::weak_ptr<Lane> lane)
+            : lane(std::move(lane))
+        {
+        }
+        LaneRef(LaneRef &&)            = default;
+        LaneRef &operator=(LaneRef &&) = default;
+
+        ~LaneRef()
+        {
+            if (std::shared_ptr<Lane> strong = lane.lock()) {
+                strong->bDetached.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    ring_t &local()
+    {
+        // keyed by id rather than address: a new set may reuse a destroyed one's memory
+        thread_local std::unordered_map<std::uint64_t, LaneRef> owned;
+        thread_local std::uint64_t                              cachedId = 0;
+        thread_local ring_t                                    *cached   = nullptr;
+        if (cachedId == id) {
+            return *cached;
+        }
+
+        auto it = owned.find(id);
+        if (it == owned.end()) {
+            // forget the sets destroyed since, their rings are already gone
+            std::erase_if(owned, [](const auto &entry) {
+                return entry.second.lane.expired();
+            });
+            auto lane = std::make_shared<Lane>(capacityPerThread);
+            it        = owned.try_emplace(id, lane).first;
+            std::lock_guard<std::mutex> lock(mutex);
+            lanes.push_back(std::move(lane));
+            registered.fetch_add(1, std::memory_order_release);
+        }
+        cachedId = id;
+        cached   = &it->second.lane.lock()->ring; // the set is alive while this thread pushes to it
+        return *cached;
+    }
+
+    // consumer only
+    void refresh()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        snapshotVersion = registered.load(std::memory_order_acquire);
+        // a detached lane gets no more records once it is drained
+        std::erase_if(lanes, [](const std::shared_ptr<Lane> &lane) {
+            return lane->bDetached.load(std::memory_order_acquire) && lane->ring.empty();
+        });
+        snapshot.clear();
+        for (auto &lane : lanes) {
+            snapshot.push_back(&lane->ring);
+        }
+    }
+
+    // consumer only
+    void drain(std::vector<T> &batch, std::size_t maxBatch)
+    {
+        if (snapshot.empty()) {
+            return;
+        }
+        T value;
+        for (std::size_t i = 0; i < snapshot.size() && batch.size() < maxBatch; ++i) {
+            ring_t *ring = snapshot[(cursor + i) % snapshot.size()];
+            while (batch.size() < maxBatch && ring->tryPop(value)) {
+                batch.emplace_back(std::move(value));
+            }
+        }
+        cursor = (cursor + 1) % snapshot.size();
+    }
+
+    static std::uint64_t nextId()
+    {
+        static std::atomic<std::uint64_t> counter{0};
+        return ++counter;
+    }
+
+    const std::uint64_t id = nextId();
+    std::size_t         capacityPerThread;
+
+    std::mutex                         mutex; // guards `lanes`
+    std::vector<std::shared_ptr<Lane>> lanes;
+    std::atomic<std::size_t>           registered{0};
+
+    // consumer only
+    std::vector<ring_t *> snapshot;
+    std::size_t           snapshotVersion = 0;
+    std::size_t           cursor          = 0;
+
+    std::atomic<bool> bShutdown{false};
+    Parker            parker;
+};
+
+
+TOP_LEVEL_NAMESPACE_END
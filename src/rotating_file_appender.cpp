@@ -0,0 +1,249 @@
+#include "rotating_file_appender.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+#ifdef LOG_CC_WITH_ZLIB
+    #include <zlib.h>
+#endif
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#elif defined(__linux__)
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+namespace fs = std::filesystem;
+
+
+static void lowerCurrentThreadPriority()
+{
+#ifdef _WIN32
+    ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+    // on Linux the nice value is per thread
+    ::setpriority(PRIO_PROCESS, (id_t)::syscall(SYS_gettid), 19);
+#endif
+}
+
+// "app.log.12" and "app.log.12.gz" -> 12, 0 for anything else
+static std::uint64_t segmentSeq(const std::string &name, const std::string &base)
+{
+    if (name.size() <= base.size() + 1 || name.compare(0, base.size(), base) != 0 || name[base.size()] != '.') {
+        return 0;
+    }
+    std::string_view rest(name);
+    rest.remove_prefix(base.size() + 1);
+    if (rest.ends_with(".gz")) {
+        rest.remove_suffix(3);
+    }
+    if (rest.empty() || !std::all_of(rest.begin(), rest.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return 0;
+    }
+    return std::stoull(std::string(rest));
+}
+
+// Returns the path to keep: the .gz on success, `path` itself otherwise
+static std::string compressSegment(const std::string &path)
+{
+#ifdef LOG_CC_WITH_ZLIB
+    std::string   gzPath = path + ".gz";
+    std::ifstream in(path, std::ios::binary);
+    gzFile        out = ::gzopen(gzPath.c_str(), "wb6");
+    if (!in || !out) {
+        if (out) {
+            ::gzclose(out);
+        }
+        return path;
+    }
+    std::vector<char> buf(1 << 16);
+    bool              bOk = true;
+    while (in) {
+        in.read(buf.data(), (std::streamsize)buf.size());
+        std::streamsize n = in.gcount();
+        if (n > 0 && ::gzwrite(out, buf.data(), (unsigned)n) != (int)n) {
+            bOk = false;
+            break;
+        }
+    }
+    bOk = (::gzclose(out) == Z_OK) && bOk;
+    std::error_code ec;
+    if (!bOk) {
+        fs::remove(gzPath, ec);
+        return path;
+    }
+    in.close();
+    fs::remove(path, ec);
+    return gzPath;
+#else
+    return path;
+#endif
+}
+
+
+RotatingFileAppender::RotatingFileAppender(std::string_view filename, RotationPolicy rotation, FlushPolicy flush)
+    : filename(filename), rotation(rotation), flushPolicy(flush)
+{
+#ifndef LOG_CC_WITH_ZLIB
+    if (this->rotation.bCompress) {
+        debug("log.cc::RotatingFileAppender"), "built without zlib, segments are not compressed", this->filename;
+        this->rotation.bCompress = false;
+    }
+#endif
+    std::error_code ec;
+    fs::path        path(this->filename);
+
+    // pick up segments left by previous runs so numbering and retention continue
+    std::vector<std::pair<std::uint64_t, std::string>> existing;
+    fs::path dir = path.has_parent_path() ? path.parent_path() : fs::path(".");
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (std::uint64_t seq = segmentSeq(name, path.filename().string())) {
+            existing.emplace_back(seq, entry.path().string());
+        }
+    }
+    std::sort(existing.begin(), existing.end());
+    for (auto &[seq, segment] : existing) {
+        segments.push_back(std::move(segment));
+        nextSeq = seq + 1;
+    }
+
+    fileSize = fs::exists(path, ec) ? (std::size_t)fs::file_size(path, ec) : 0;
+    file     = RawFileAppender(this->filename, flushPolicy);
+    scheduleNextRotation();
+
+    archiver = std::thread([this]() {
+        lowerCurrentThreadPriority();
+        archiverLoop();
+    });
+}
+
+RotatingFileAppender::~RotatingFileAppender()
+{
+    file.flush();
+    {
+        std::lock_guard<std::mutex> lock(archiveMutex);
+        bStop = true;
+    }
+    archiveCv.notify_one();
+    if (archiver.joinable()) {
+        archiver.join();
+    }
+}
+
+void RotatingFileAppender::scheduleNextRotation()
+{
+    if (rotation.interval.count() <= 0) {
+        nextRotationSec = 0;
+        return;
+    }
+    std::int64_t now      = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::int64_t interval = rotation.interval.count();
+    nextRotationSec       = (now / interval + 1) * interval;
+}
+
+void RotatingFileAppender::write(std::span<const MessageElem> batch)
+{
+    std::size_t begin = 0;
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        // rotate between records, a record never straddles two segments
+        if (rotation.maxBytes && fileSize + bytes >= rotation.maxBytes && i > begin) {
+            file.write(batch.subspan(begin, i - begin));
+            fileSize += bytes;
+            rotate();
+            begin = i;
+            bytes = 0;
+        }
+        bytes += batch[i].msg.size();
+    }
+    file.write(batch.subspan(begin));
+    fileSize += bytes;
+    poll();
+}
+
+void RotatingFileAppender::flush()
+{
+    file.flush();
+}
+
+void RotatingFileAppender::poll()
+{
+    if (nextRotationSec != 0) {
+        std::int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        if (now >= nextRotationSec) {
+            if (fileSize > 0) {
+                rotate();
+            }
+            scheduleNextRotation();
+        }
+    }
+    if (rotation.maxBytes && fileSize >= rotation.maxBytes) {
+        rotate();
+    }
+    file.poll();
+}
+
+void RotatingFileAppender::rotate()
+{
+    // close first: Windows cannot rename an open file
+    file = RawFileAppender();
+
+    std::string     segment = filename + "." + std::to_string(nextSeq++);
+    std::error_code ec;
+    fs::rename(filename, segment, ec);
+    if (ec) {
+        debug("log.cc::RotatingFileAppender"), "rotate failed", filename, ec.message();
+    }
+
+    file     = RawFileAppender(filename, flushPolicy);
+    fileSize = 0;
+
+    if (!ec) {
+        {
+            std::lock_guard<std::mutex> lock(archiveMutex);
+            pending.push_back(std::move(segment));
+        }
+        archiveCv.notify_one();
+    }
+}
+
+void RotatingFileAppender::archiverLoop()
+{
+    std::unique_lock<std::mutex> lock(archiveMutex);
+    for (;;) {
+        archiveCv.wait(lock, [this]() {
+            return bStop || !pending.empty();
+        });
+        if (pending.empty()) {
+            return; // stopped and nothing left
+        }
+        std::string segment = std::move(pending.front());
+        pending.pop_front();
+        lock.unlock();
+
+        if (rotation.bCompress) {
+            segment = compressSegment(segment);
+        }
+        segments.push_back(std::move(segment));
+        while (segments.size() > rotation.maxSegments) {
+            std::error_code ec;
+            fs::remove(segments.front(), ec);
+            segments.pop_front();
+        }
+
+        lock.lock();
+    }
+}
+
+
+TOP_LEVEL_NAMESPACE_END
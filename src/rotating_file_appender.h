@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "base.h"
+#include "log.h"
+#include "raw_file_appender.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+struct RotationPolicy
+{
+    std::size_t          maxBytes    = 64 << 20; // rotate once the file reaches this size, 0 disables
+    std::chrono::seconds interval{0};            // rotate on wall-clock boundaries (e.g. 3600: every hour), 0 disables
+    std::size_t          maxSegments = 5;        // rotated segments kept, the oldest are deleted
+    bool                 bCompress   = false;    // gzip closed segments (needs the xmake "zlib" option, else a warning)
+};
+
+
+// Writes to `filename` and rotates it into `filename.<seq>` by size and/or time.
+// The rename and reopen happen on the AsyncLogControl worker, compressing and pruning
+// closed segments on a low-priority archiver thread, so neither stalls the worker:
+//   logCore->addAppender<RotatingFileAppender>("app.log", RotationPolicy{.maxBytes = 256 << 20, .bCompress = true});
+struct LOG_CC_API RotatingFileAppender
+{
+    RotatingFileAppender(std::string_view filename, RotationPolicy rotation = {}, FlushPolicy flush = {});
+    ~RotatingFileAppender();
+
+    RotatingFileAppender(const RotatingFileAppender &)            = delete;
+    RotatingFileAppender &operator=(const RotatingFileAppender &) = delete;
+
+    void operator<<(const MessageElem &elem) { write(std::span<const MessageElem>(&elem, 1)); }
+
+    void write(std::span<const MessageElem> batch);
+    void flush();
+    void poll();
+
+    // Close the current file as a new segment and start an empty one
+    void rotate();
+
+  private:
+    void scheduleNextRotation();
+    void archiverLoop();
+
+    std::string     filename;
+    RotationPolicy  rotation;
+    FlushPolicy     flushPolicy;
+    RawFileAppender file;
+    std::size_t     fileSize = 0;
+    std::int64_t    nextRotationSec = 0; // system_clock seconds, 0 when time rotation is off
+    std::uint64_t   nextSeq         = 1;
+
+    // archiver: segments waiting for compression, then retention over all known segments
+    std::mutex              archiveMutex;
+    std::condition_variable archiveCv;
+    std::deque<std::string> pending;
+    std::deque<std::string> segments; // oldest first, archiver only
+    bool                    bStop = false;
+    std::thread             archiver;
+};
+
+
+TOP_LEVEL_NAMESPACE_END
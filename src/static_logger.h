@@ -0,0 +1,130 @@
+#pragma once
+
+#include <format>
+#include <iterator>
+#include <mutex>
+#include <source_location>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "base.h"
+#include "deferred_args.h"
+#include "log.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+// Logger whose formatter and sinks are template parameters, so the level check,
+// the formatter and every sink write are direct calls the compiler can inline
+// (AsyncLogger / SyncLogger keep the std::function based, runtime configurable path):
+//
+//   Logger<PatternFormatter<"[%l] %v">, ConsoleAppender, FileAppender> logger({}, {}, FileAppender("a.log"));
+//   logger.info("x={}", x);
+//
+// A sink is anything with `operator<<(const MessageElem &)`.
+template <typename Formatter, typename... Sinks>
+struct Logger
+{
+    Config               config;
+    Formatter            formatter;
+    std::tuple<Sinks...> sinks;
+
+    Logger() = default;
+
+    Logger(Formatter formatter, Sinks... sinks)
+        : formatter(std::move(formatter)), sinks(std::move(sinks)...)
+    {
+    }
+
+    Logger(const Logger &)            = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    template <typename Sink>
+    Sink &sink()
+    {
+        return std::get<Sink>(sinks);
+    }
+
+    void log(LogLevel::T level, std::string_view msg, std::source_location location = std::source_location::current())
+    {
+        if (level < config.logLevel) {
+            return;
+        }
+        std::string &output = threadLocalBuffer();
+        output.clear();
+        if (formatter(config, output, level, msg, location)) {
+            write(level, output);
+        }
+    }
+
+    // clang-format off
+    template <typename... Args> void debug(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args) { logFormat(LogLevel::Debug, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void trace(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args) { logFormat(LogLevel::Trace, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void info(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args)  { logFormat(LogLevel::Info, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void warn(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args)  { logFormat(LogLevel::Warn, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void error(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args) { logFormat(LogLevel::Error, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    template <typename... Args> void fatal(FormatLocation<std::type_identity_t<Args>...> fmt, Args &&...args) { logFormat(LogLevel::Fatal, fmt.location, fmt.fmt, std::forward<Args>(args)...); }
+    // clang-format on
+
+    template <typename... Args>
+    void logFormat(LogLevel::T level, const std::source_location &location, std::format_string<Args...> fmt, Args &&...args)
+    {
+        if (level < config.logLevel) {
+            return;
+        }
+        std::string &output = threadLocalBuffer();
+        output.clear();
+        if constexpr (PrefixFormatter<Formatter>) {
+            formatter.appendPrefix(config, output, level, location);
+            std::format_to(std::back_inserter(output), fmt, std::forward<Args>(args)...);
+            output.push_back('\n');
+        }
+        else {
+            std::string msg = std::format(fmt, std::forward<Args>(args)...);
+            if (!formatter(config, output, level, msg, location)) {
+                return;
+            }
+        }
+        write(level, output);
+    }
+
+    using call_site_t = CallSiteMeta; // for LOG_CC_INFO() & co
+
+    template <typename... Args>
+    void logSite(const CallSiteMeta &site, std::format_string<Args...> fmt, Args &&...args)
+    {
+        if constexpr (requires(std::string &output) { formatter.appendPrefix(config, output, site.level, site.file, site.line); }) {
+            if (site.level < config.logLevel) {
+                return;
+            }
+            std::string &output = threadLocalBuffer();
+            output.clear();
+            formatter.appendPrefix(config, output, site.level, site.file, site.line);
+            std::format_to(std::back_inserter(output), fmt, std::forward<Args>(args)...);
+            output.push_back('\n');
+            write(site.level, output);
+        }
+        else {
+            logFormat(site.level, site.location, fmt, std::forward<Args>(args)...);
+        }
+    }
+
+  private:
+    void write(LogLevel::T level, std::string &record)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        MessageElem                 elem{.level = level, .msg = std::move(record)};
+        std::apply([&elem](Sinks &...sink) { ((sink << elem), ...); }, sinks);
+        record = std::move(elem.msg);
+    }
+
+    std::mutex mutex; // serializes sink writes
+};
+
+
+TOP_LEVEL_NAMESPACE_END
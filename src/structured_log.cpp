@@ -0,0 +1,243 @@
+#include "structured_log.h"
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define LOG_CC_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+#include "log.h"
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+static constexpr std::string_view levelNames[LogLevel::Count] = {"debug", "trace", "info", "warn", "error", "fatal"};
+
+
+static bool bEscaped(unsigned char c)
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Index of the first byte of [data, data + size) that needs escaping, `size` if none
+static std::size_t findEscape(const char *data, std::size_t size)
+{
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    {
+        const __m256i quote     = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i control   = _mm256_set1_epi8(0x1f);
+        for (; i + 32 <= size; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+            // max(v, 0x1f) == 0x1f  <=>  v <= 0x1f as unsigned bytes
+            __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                                          _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control));
+            if (std::uint32_t mask = (std::uint32_t)_mm256_movemask_epi8(hit)) {
+                return i + (std::size_t)std::countr_zero(mask);
+            }
+        }
+    }
+#endif
+#if defined(LOG_CC_SSE2)
+    {
+        const __m128i quote     = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control   = _mm_set1_epi8(0x1f);
+        for (; i + 16 <= size; i += 16) {
+            __m128i v   = _mm_loadu_si128((const __m128i *)(data + i));
+            __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                       _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+            if (std::uint32_t mask = (std::uint32_t)_mm_movemask_epi8(hit)) {
+                return i + (std::size_t)std::countr_zero(mask);
+            }
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        if (bEscaped((unsigned char)data[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+void appendEscaped(std::string &output, std::string_view str)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    for (;;) {
+        std::size_t n = findEscape(str.data(), str.size());
+        output.append(str.data(), n);
+        if (n == str.size()) {
+            return;
+        }
+        unsigned char c = (unsigned char)str[n];
+        switch (c) {
+        case '"': output += "\\\""; break;
+        case '\\': output += "\\\\"; break;
+        case '\n': output += "\\n"; break;
+        case '\r': output += "\\r"; break;
+        case '\t': output += "\\t"; break;
+        case '\b': output += "\\b"; break;
+        case '\f': output += "\\f"; break;
+        default:
+            output += "\\u00";
+            output += hex[c >> 4];
+            output += hex[c & 0xf];
+            break;
+        }
+        str.remove_prefix(n + 1);
+    }
+}
+
+
+template <typename T>
+static void appendNumber(std::string &output, T value)
+{
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    output.append(buffer, end);
+}
+
+// true/false/null/numbers as JSON and logfmt both spell them
+static void appendScalar(std::string &output, const Field &field)
+{
+    switch (field.type) {
+    case Field::EType::Null: output += "null"; break;
+    case Field::EType::Bool: output += field.b ? "true" : "false"; break;
+    case Field::EType::Int: appendNumber(output, field.i); break;
+    case Field::EType::Uint: appendNumber(output, field.u); break;
+    case Field::EType::Double:
+        if (std::isfinite(field.d)) {
+            appendNumber(output, field.d);
+        }
+        else {
+            output += "null";
+        }
+        break;
+    case Field::EType::String: break;
+    }
+}
+
+static void appendJsonString(std::string &output, std::string_view str)
+{
+    output += '"';
+    appendEscaped(output, str);
+    output += '"';
+}
+
+static void appendJsonMember(std::string &output, std::string_view key, std::string_view value)
+{
+    output += ',';
+    appendJsonString(output, key);
+    output += ':';
+    appendJsonString(output, value);
+}
+
+// logfmt values are bare unless they contain a space, '=', a quote or a control byte
+static void appendLogfmtValue(std::string &output, std::string_view str)
+{
+    bool bQuote = str.empty();
+    for (char c : str) {
+        if ((unsigned char)c <= ' ' || c == '=' || c == '"' || c == '\\') {
+            bQuote = true;
+            break;
+        }
+    }
+    if (!bQuote) {
+        output += str;
+        return;
+    }
+    appendJsonString(output, str);
+}
+
+void appendLogfmtFields(std::string &output, std::span<const Field> fields)
+{
+    for (const Field &field : fields) {
+        output += ' ';
+        output += field.key;
+        output += '=';
+        if (field.type == Field::EType::String) {
+            appendLogfmtValue(output, field.str);
+        }
+        else {
+            appendScalar(output, field);
+        }
+    }
+}
+
+
+bool JsonEncoder::operator()(const Config &config, std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location) const
+{
+    output.clear();
+    encode(config, output, level, msg, {}, location);
+    return true;
+}
+
+void JsonEncoder::encode(const Config &config, std::string &output, LogLevel::T level, std::string_view msg,
+                         std::span<const Field> fields, const std::source_location &location) const
+{
+    output += "{\"level\":\"";
+    output += levelNames[LogLevel::toIndex(level)];
+    output += '"';
+    if (!category.empty()) {
+        appendJsonMember(output, "category", category);
+    }
+    appendJsonMember(output, "msg", msg);
+    if (level >= config.logDetailLevel) {
+        appendJsonMember(output, "file", location.file_name());
+        output += ",\"line\":";
+        appendNumber(output, location.line());
+    }
+    for (const Field &field : fields) {
+        output += ',';
+        appendJsonString(output, field.key);
+        output += ':';
+        if (field.type == Field::EType::String) {
+            appendJsonString(output, field.str);
+        }
+        else {
+            appendScalar(output, field);
+        }
+    }
+    output += "}\n";
+}
+
+
+bool LogfmtEncoder::operator()(const Config &config, std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location) const
+{
+    output.clear();
+    encode(config, output, level, msg, {}, location);
+    return true;
+}
+
+void LogfmtEncoder::encode(const Config &config, std::string &output, LogLevel::T level, std::string_view msg,
+                           std::span<const Field> fields, const std::source_location &location) const
+{
+    output += "level=";
+    output += levelNames[LogLevel::toIndex(level)];
+    if (!category.empty()) {
+        output += " category=";
+        appendLogfmtValue(output, category);
+    }
+    output += " msg=";
+    appendLogfmtValue(output, msg);
+    if (level >= config.logDetailLevel) {
+        output += " file=";
+        appendLogfmtValue(output, location.file_name());
+        output += " line=";
+        appendNumber(output, location.line());
+    }
+    appendLogfmtFields(output, fields);
+    output += '\n';
+}
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+#include <source_location>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "base.h"
+#include "log_level.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+struct Config;
+
+
+// One key-value pair of a structured record, see LoggerBase::log(level, msg, fields).
+// Values are kept as they are, only the encoder turns them into text; strings are
+// borrowed, so a Field must not outlive the call it is passed to.
+struct Field
+{
+    enum class EType : std::uint8_t
+    {
+        Null,
+        Bool,
+        Int,
+        Uint,
+        Double,
+        String,
+    };
+
+    std::string_view key;
+    EType            type = EType::Null;
+    union
+    {
+        bool          b;
+        std::int64_t  i;
+        std::uint64_t u;
+        double        d;
+    };
+    std::string_view str;
+
+    Field(std::string_view key, std::nullptr_t)
+        : key(key), i(0)
+    {
+    }
+
+    template <typename T>
+        requires std::integral<T> || std::floating_point<T>
+    Field(std::string_view key, T value)
+        : key(key)
+    {
+        if constexpr (std::same_as<T, bool>) {
+            type = EType::Bool;
+            b    = value;
+        }
+        else if constexpr (std::floating_point<T>) {
+            type = EType::Double;
+            d    = (double)value;
+        }
+        else if constexpr (std::signed_integral<T>) {
+            type = EType::Int;
+            i    = value;
+        }
+        else {
+            type = EType::Uint;
+            u    = value;
+        }
+    }
+
+    template <typename T>
+        requires std::convertible_to<const T &, std::string_view> && (!std::is_pointer_v<T>)
+    Field(std::string_view key, const T &value)
+        : key(key), type(EType::String), i(0), str(value)
+    {
+    }
+
+    // a null C string is a null value
+    Field(std::string_view key, const char *value)
+        : key(key), type(value ? EType::String : EType::Null), i(0), str(value ? value : "")
+    {
+    }
+};
+
+
+// Appends `str` with JSON string escaping (without the quotes). The search for the next
+// byte to escape runs 32 (AVX2) or 16 (SSE2) bytes at a time where available.
+extern LOG_CC_API void appendEscaped(std::string &output, std::string_view str);
+
+// Appends " key=value" per field, quoting values that need it
+extern LOG_CC_API void appendLogfmtFields(std::string &output, std::span<const Field> fields);
+
+
+// Formatters that render a whole record, fields included, as one line; set with
+// LoggerBase::setFormatter(). Records without fields go through operator() as usual.
+template <typename E>
+concept FieldEncoder = requires(const E &e, const Config &config, std::string &output, std::span<const Field> fields, const std::source_location &location) {
+    e.encode(config, output, LogLevel::Info, std::string_view{}, fields, location);
+};
+
+// {"level":"info","msg":"...","file":"a.cpp","line":1,"key":value}
+// The file and line follow Config::logDetailLevel like the DefaultFormatter.
+// With AsyncLogControl::timePrecision set the stamp goes in front of the object,
+// so leave it at None for JSON lines.
+struct LOG_CC_API JsonEncoder
+{
+    std::string category; // "category" member when not empty
+
+    bool operator()(const Config &config, std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location) const;
+    void encode(const Config &config, std::string &output, LogLevel::T level, std::string_view msg,
+                std::span<const Field> fields, const std::source_location &location) const;
+};
+
+// level=info msg="..." file=a.cpp line=1 key=value
+struct LOG_CC_API LogfmtEncoder
+{
+    std::string category; // "category=" pair when not empty
+
+    bool operator()(const Config &config, std::string &output, LogLevel::T level, std::string_view msg, const std::source_location &location) const;
+    void encode(const Config &config, std::string &output, LogLevel::T level, std::string_view msg,
+                std::span<const Field> fields, const std::source_location &location) const;
+};
+
+
+TOP_LEVEL_NAMESPACE_END
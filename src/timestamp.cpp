@@ -0,0 +1,111 @@
+#include "timestamp.h"
+
+#include <ctime>
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+static constexpr std::int64_t NsPerSecond = 1'000'000'000;
+// steady_clock and system_clock drift apart (NTP slewing), re-pair them now and then
+static constexpr std::int64_t ReanchorIntervalNs = 60 * NsPerSecond;
+
+
+TimestampFormatter::TimestampFormatter()
+{
+    anchor();
+}
+
+void TimestampFormatter::anchor()
+{
+    using namespace std::chrono;
+    anchorSystemNs = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+    anchorSteadyNs = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::int64_t TimestampFormatter::toWallNs(std::int64_t steadyNs)
+{
+    if (steadyNs - anchorSteadyNs > ReanchorIntervalNs) {
+        anchor();
+    }
+    return anchorSystemNs + (steadyNs - anchorSteadyNs);
+}
+
+void TimestampFormatter::append(std::string &output, std::int64_t tick, ETimePrecision precision)
+{
+    if (precision == ETimePrecision::None) {
+        return;
+    }
+    appendWall(output, toWallNs(tick), precision);
+}
+
+void TimestampFormatter::appendWall(std::string &output, std::int64_t wallNs, ETimePrecision precision)
+{
+    if (precision == ETimePrecision::None) {
+        return;
+    }
+
+    std::int64_t second = wallNs / NsPerSecond;
+    std::int64_t frac   = wallNs % NsPerSecond;
+
+    if (second != cachedSecond) {
+        cachedSecond   = second;
+        std::time_t tt = (std::time_t)second;
+        std::tm     tm{};
+#ifdef _WIN32
+        ::localtime_s(&tm, &tt);
+#else
+        ::localtime_r(&tt, &tm);
+#endif
+        cachedPrefixSize = std::strftime(cachedPrefix, sizeof(cachedPrefix), "%Y-%m-%d %H:%M:%S", &tm);
+    }
+    output.append(cachedPrefix, cachedPrefixSize);
+
+    int digits = 0;
+    switch (precision) {
+    case ETimePrecision::Milli:
+        digits = 3;
+        frac /= 1'000'000;
+        break;
+    case ETimePrecision::Micro:
+        digits = 6;
+        frac /= 1'000;
+        break;
+    case ETimePrecision::Nano:
+        digits = 9;
+        break;
+    default:
+        return;
+    }
+
+    char buf[10];
+    buf[0] = '.';
+    for (int i = digits; i > 0; --i) {
+        buf[i] = char('0' + frac % 10);
+        frac /= 10;
+    }
+    output.append(buf, digits + 1);
+}
+
+// 0 = no RecordTimeScope
+static thread_local std::int64_t recordTick = 0;
+
+void appendCurrentTimestamp(std::string &output, ETimePrecision precision)
+{
+    thread_local TimestampFormatter formatter;
+    formatter.append(output, recordTick != 0 ? recordTick : timestampNow(), precision);
+}
+
+RecordTimeScope::RecordTimeScope(std::int64_t tick)
+    : previous(recordTick)
+{
+    recordTick = tick;
+}
+
+RecordTimeScope::~RecordTimeScope()
+{
+    recordTick = previous;
+}
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "base.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+enum class ETimePrecision
+{
+    None = 0, // no timestamp in the record
+    Second,   // 2024-01-02 03:04:05
+    Milli,    // 2024-01-02 03:04:05.123
+    Micro,    // 2024-01-02 03:04:05.123456
+    Nano,     // 2024-01-02 03:04:05.123456789
+};
+
+// Steady-clock nanoseconds taken on the logging thread, a vDSO clock read with no formatting
+inline std::int64_t timestampNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Renders timestampNow() values as local wall-clock time.
+// The "date time" part is cached and only rebuilt when the second changes,
+// the fraction is appended by hand; not thread safe, one per consumer thread.
+struct LOG_CC_API TimestampFormatter
+{
+    TimestampFormatter();
+
+    void append(std::string &output, std::int64_t tick, ETimePrecision precision);
+    // same, for nanoseconds since the Unix epoch
+    void appendWall(std::string &output, std::int64_t wallNs, ETimePrecision precision);
+
+    // timestampNow() value -> nanoseconds since the Unix epoch
+    std::int64_t toWallNs(std::int64_t steadyNs);
+
+  private:
+    void anchor();
+
+    std::int64_t anchorSteadyNs = 0;
+    std::int64_t anchorSystemNs = 0;
+
+    std::int64_t cachedSecond = -1;
+    char         cachedPrefix[32]{};
+    std::size_t  cachedPrefixSize = 0;
+};
+
+// Time of the record being formatted on this thread through a per-thread TimestampFormatter:
+// the current time, or the tick of a RecordTimeScope around the call
+extern LOG_CC_API void appendCurrentTimestamp(std::string &output, ETimePrecision precision);
+
+// While alive, appendCurrentTimestamp() on this thread renders `tick` instead of now.
+// The async worker sets one around deferred records, so they show when they were logged.
+struct LOG_CC_API RecordTimeScope
+{
+    explicit RecordTimeScope(std::int64_t tick);
+    ~RecordTimeScope();
+
+    RecordTimeScope(const RecordTimeScope &)            = delete;
+    RecordTimeScope &operator=(const RecordTimeScope &) = delete;
+
+  private:
+    std::int64_t previous;
+};
+
+
+TOP_LEVEL_NAMESPACE_END
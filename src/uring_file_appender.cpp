@@ -0,0 +1,466 @@
+#include "uring_file_appender.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #define LOG_CC_HAS_URING 1
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+#endif
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+#ifdef LOG_CC_HAS_URING
+
+// No liburing: the three syscalls and the ring layout are all we need
+static int uringSetup(unsigned entries, io_uring_params &params)
+{
+    return (int)::syscall(__NR_io_uring_setup, entries, &params);
+}
+
+static int uringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int)::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static int uringRegister(int ringFd, unsigned opcode, const void *arg, unsigned count)
+{
+    return (int)::syscall(__NR_io_uring_register, ringFd, opcode, arg, count);
+}
+
+
+struct UringFileAppender::Ring
+{
+    static constexpr std::uint32_t None = UINT32_MAX;
+
+    struct Buffer
+    {
+        char         *data;
+        std::size_t   used    = 0; // filled by append()
+        std::size_t   written = 0; // confirmed by completions, after submit
+        std::uint64_t offset  = 0; // file offset of data[0], set on submit
+        bool          bInFlight = false;
+    };
+
+    int                        fd     = -1;
+    int                        ringFd = -1;
+    std::size_t                bufferSize;
+    char                      *memory     = nullptr; // every buffer, page aligned
+    std::size_t                memorySize = 0;
+    std::vector<Buffer>        buffers;
+    std::vector<std::uint32_t> freeBuffers;
+    std::uint32_t              current  = None; // being filled
+    std::uint32_t              inFlight = 0;
+    std::uint64_t              fileEnd  = 0; // where the next submitted buffer goes
+    std::size_t                pendingRecords = 0;
+    bool                       bFailed        = false; // a write went wrong, see writeSync()
+    bool                       bDead          = false; // io_uring_enter failed for good, see abandon()
+    std::chrono::steady_clock::time_point lastSubmit = std::chrono::steady_clock::now();
+
+    // rings shared with the kernel
+    void          *sqMap     = nullptr;
+    std::size_t    sqMapSize = 0;
+    void          *cqMap     = nullptr;
+    std::size_t    cqMapSize = 0;
+    io_uring_sqe  *sqes      = nullptr;
+    std::size_t    sqesSize  = 0;
+    std::uint32_t *sqTail, *sqArray, sqMask;
+    std::uint32_t *cqHead, *cqTail, cqMask;
+    io_uring_cqe  *cqes;
+
+    ~Ring()
+    {
+        if (ringFd >= 0) {
+            ::close(ringFd); // also unregisters the buffers
+        }
+        if (sqes) {
+            ::munmap(sqes, sqesSize);
+        }
+        if (cqMap && cqMap != sqMap) {
+            ::munmap(cqMap, cqMapSize);
+        }
+        if (sqMap) {
+            ::munmap(sqMap, sqMapSize);
+        }
+        if (memory) {
+            ::munmap(memory, memorySize);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    bool init(const std::string &filename, std::size_t bufferSize, std::size_t bufferCount)
+    {
+        io_uring_params params{};
+        ringFd = uringSetup((unsigned)bufferCount, params);
+        if (ringFd < 0) {
+            return false;
+        }
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+        }
+        sqMap = ::mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED) {
+            sqMap = nullptr;
+            return false;
+        }
+        cqMap = sqMap;
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+            cqMap = ::mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+            if (cqMap == MAP_FAILED) {
+                cqMap = nullptr;
+                return false;
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqesMap = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqesMap == MAP_FAILED) {
+            return false;
+        }
+        sqes = (io_uring_sqe *)sqesMap;
+
+        char *sq = (char *)sqMap;
+        char *cq = (char *)cqMap;
+        sqTail   = (std::uint32_t *)(sq + params.sq_off.tail);
+        sqArray  = (std::uint32_t *)(sq + params.sq_off.array);
+        sqMask   = *(std::uint32_t *)(sq + params.sq_off.ring_mask);
+        cqHead   = (std::uint32_t *)(cq + params.cq_off.head);
+        cqTail   = (std::uint32_t *)(cq + params.cq_off.tail);
+        cqMask   = *(std::uint32_t *)(cq + params.cq_off.ring_mask);
+        cqes     = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+        this->bufferSize = bufferSize;
+        memorySize       = bufferSize * bufferCount;
+        void *mem        = ::mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            return false;
+        }
+        memory = (char *)mem;
+        std::vector<iovec> iovecs;
+        for (std::size_t i = 0; i < bufferCount; ++i) {
+            buffers.push_back(Buffer{.data = memory + i * bufferSize});
+            iovecs.push_back(iovec{.iov_base = buffers.back().data, .iov_len = bufferSize});
+            freeBuffers.push_back((std::uint32_t)(bufferCount - 1 - i));
+        }
+        if (uringRegister(ringFd, IORING_REGISTER_BUFFERS, iovecs.data(), (unsigned)iovecs.size()) < 0) {
+            return false; // e.g. RLIMIT_MEMLOCK on older kernels
+        }
+
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        off_t end = ::lseek(fd, 0, SEEK_END);
+        fileEnd   = end < 0 ? 0 : (std::uint64_t)end;
+        return true;
+    }
+
+    // Queues a write of buffers[index] from `written` on, and submits it
+    void submitWrite(std::uint32_t index)
+    {
+        if (bDead) {
+            writeSync(index);
+            release(index);
+            return;
+        }
+        Buffer       &buffer = buffers[index];
+        std::uint32_t tail   = std::atomic_ref<std::uint32_t>(*sqTail).load(std::memory_order_relaxed);
+        io_uring_sqe &sqe    = sqes[tail & sqMask];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode    = IORING_OP_WRITE_FIXED;
+        sqe.fd        = fd;
+        sqe.addr      = (std::uint64_t)(std::uintptr_t)(buffer.data + buffer.written);
+        sqe.len       = (std::uint32_t)(buffer.used - buffer.written);
+        sqe.off       = buffer.offset + buffer.written;
+        sqe.buf_index = (std::uint16_t)index;
+        sqe.user_data = index;
+        sqArray[tail & sqMask] = tail & sqMask;
+        std::atomic_ref<std::uint32_t>(*sqTail).store(tail + 1, std::memory_order_release);
+
+        // EAGAIN / EBUSY: the kernel is short of memory or completions, so give the writes
+        // in flight a moment, for about a second at most
+        for (int retry = 0; uringEnter(ringFd, 1, 0, 0) < 0; ++retry) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EBUSY) && retry < 1000) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            // not consumed: take the entry back, this buffer is written with the others
+            std::atomic_ref<std::uint32_t>(*sqTail).store(tail, std::memory_order_release);
+            abandon(errno);
+            return;
+        }
+    }
+
+    // The rest of buffers[index], with pwrite() at its offset so the file has no gap, and
+    // the appender leaves the ring for its fallback (see UringFileAppender::leaveRing())
+    void writeSync(std::uint32_t index)
+    {
+        Buffer &buffer = buffers[index];
+        bFailed        = true;
+        buffer.written += writeAt(buffer.data + buffer.written, buffer.used - buffer.written, buffer.offset + buffer.written);
+    }
+
+    // pwrite() until done or failed; the bytes written
+    std::size_t writeAt(const char *data, std::size_t size, std::uint64_t offset)
+    {
+        std::size_t done = 0;
+        while (done < size) {
+            ssize_t n = ::pwrite(fd, data + done, size - done, (off_t)(offset + done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                debug("log.cc::UringFileAppender"), "write failed, records lost", n < 0 ? errno : 0;
+                break;
+            }
+            done += (std::size_t)n;
+        }
+        return done;
+    }
+
+    // io_uring_enter failed for good, so completions may never arrive: every buffer in flight
+    // is written here (the kernel may still write it too: the same bytes at the same offset).
+    // Those buffers are not reused, the kernel could still be reading them; the rest of the
+    // writes are synchronous until the appender leaves the ring.
+    void abandon(int error)
+    {
+        debug("log.cc::UringFileAppender"), "io_uring_enter failed", error;
+        bDead = true;
+        for (std::uint32_t i = 0; i < buffers.size(); ++i) {
+            if (buffers[i].bInFlight) {
+                writeSync(i);
+                buffers[i].bInFlight = false;
+                --inFlight;
+            }
+        }
+    }
+
+    // buffers[index] is written, or given up on
+    void release(std::uint32_t index)
+    {
+        buffers[index].used      = 0;
+        buffers[index].bInFlight = false;
+        --inFlight;
+        freeBuffers.push_back(index);
+    }
+
+    // Hands the buffer being filled to the kernel
+    void submitCurrent()
+    {
+        lastSubmit     = std::chrono::steady_clock::now();
+        pendingRecords = 0;
+        if (current == None || buffers[current].used == 0) {
+            return;
+        }
+        Buffer &buffer = buffers[current];
+        buffer.offset  = fileEnd;
+        buffer.written = 0;
+        fileEnd += buffer.used;
+        buffer.bInFlight = true;
+        ++inFlight;
+        submitWrite(current);
+        current = None;
+    }
+
+    // Recycles the buffers whose writes completed; with `bWait`, waits for at least one
+    void reap(bool bWait)
+    {
+        if (bDead) {
+            return; // late completions are of abandoned buffers
+        }
+        if (bWait && inFlight > 0) {
+            int ret;
+            while ((ret = uringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS)) < 0 && errno == EINTR) {
+            }
+            if (ret < 0) {
+                abandon(errno);
+                return;
+            }
+        }
+        std::uint32_t head = std::atomic_ref<std::uint32_t>(*cqHead).load(std::memory_order_relaxed);
+        std::uint32_t tail = std::atomic_ref<std::uint32_t>(*cqTail).load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            const io_uring_cqe &cqe   = cqes[head & cqMask];
+            std::uint32_t       index = (std::uint32_t)cqe.user_data;
+            Buffer             &buffer = buffers[index];
+            if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+                submitWrite(index);
+                continue;
+            }
+            if (cqe.res > 0) {
+                buffer.written += (std::size_t)cqe.res;
+                if (buffer.written < buffer.used) {
+                    submitWrite(index); // short write: the rest
+                    continue;
+                }
+            }
+            else {
+                // an error, or no progress at all: later buffers may already be in the file
+                debug("log.cc::UringFileAppender"), "write failed", -cqe.res;
+                writeSync(index);
+            }
+            release(index);
+        }
+        std::atomic_ref<std::uint32_t>(*cqHead).store(head, std::memory_order_release);
+    }
+
+    void append(std::string_view msg)
+    {
+        while (!msg.empty()) {
+            if (current == None) {
+                while (freeBuffers.empty() && !bDead) {
+                    reap(true);
+                }
+                if (freeBuffers.empty()) {
+                    // dead with every buffer abandoned: straight to the file
+                    writeAt(msg.data(), msg.size(), fileEnd);
+                    fileEnd += msg.size();
+                    return;
+                }
+                current = freeBuffers.back();
+                freeBuffers.pop_back();
+            }
+            Buffer     &buffer = buffers[current];
+            std::size_t n      = std::min(msg.size(), bufferSize - buffer.used);
+            std::memcpy(buffer.data + buffer.used, msg.data(), n);
+            buffer.used += n;
+            msg.remove_prefix(n);
+            if (buffer.used == bufferSize) {
+                submitCurrent();
+            }
+        }
+    }
+
+    void drain()
+    {
+        submitCurrent();
+        while (inFlight > 0) {
+            reap(true);
+        }
+    }
+};
+
+#else
+
+struct UringFileAppender::Ring
+{
+};
+
+#endif
+
+
+UringFileAppender::UringFileAppender(std::string_view filename, FlushPolicy policy, std::size_t bufferCount)
+    : filename(filename), policy(policy)
+{
+#ifdef LOG_CC_HAS_URING
+    if (this->policy.bufferSize == 0) {
+        this->policy.bufferSize = 1;
+    }
+    ring = std::make_unique<Ring>();
+    if (ring->init(this->filename, this->policy.bufferSize, std::max<std::size_t>(bufferCount, 1))) {
+        return;
+    }
+    ring.reset();
+#endif
+    fallback = RawFileAppender(filename, policy);
+}
+
+UringFileAppender::~UringFileAppender()
+{
+    flush();
+}
+
+bool UringFileAppender::isOpen() const
+{
+    return ring || fallback.isOpen();
+}
+
+void UringFileAppender::write(std::span<const MessageElem> batch)
+{
+#ifdef LOG_CC_HAS_URING
+    if (ring) {
+        ring->reap(false);
+        bool bFlushLevel = false;
+        for (const MessageElem &elem : batch) {
+            ring->append(elem.msg);
+            bFlushLevel |= elem.level >= policy.flushLevel;
+        }
+        ring->pendingRecords += batch.size();
+
+        std::size_t used = ring->current == Ring::None ? 0 : ring->buffers[ring->current].used;
+        if (bFlushLevel ||
+            (policy.flushBytes && used >= policy.flushBytes) ||
+            (policy.flushRecords && ring->pendingRecords >= policy.flushRecords))
+        {
+            ring->submitCurrent();
+        }
+        leaveRing();
+        return;
+    }
+#endif
+    fallback.write(batch);
+}
+
+void UringFileAppender::flush()
+{
+#ifdef LOG_CC_HAS_URING
+    if (ring) {
+        ring->drain();
+        if (policy.bSync) {
+            ::fdatasync(ring->fd);
+        }
+        leaveRing();
+        return;
+    }
+#endif
+    fallback.flush();
+}
+
+void UringFileAppender::poll()
+{
+#ifdef LOG_CC_HAS_URING
+    if (ring) {
+        ring->reap(false);
+        if (policy.flushInterval.count() > 0 && std::chrono::steady_clock::now() - ring->lastSubmit >= policy.flushInterval) {
+            ring->submitCurrent();
+        }
+        leaveRing();
+        return;
+    }
+#endif
+    fallback.poll();
+}
+
+void UringFileAppender::leaveRing()
+{
+#ifdef LOG_CC_HAS_URING
+    if (ring && ring->bFailed) {
+        ring->drain(); // what is still buffered or in flight goes to its offset first
+        ring.reset();
+        fallback = RawFileAppender(filename, policy);
+    }
+#endif
+}
+
+
+TOP_LEVEL_NAMESPACE_END
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "base.h"
+#include "log.h"
+#include "raw_file_appender.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+// File appender that hands its writes to io_uring instead of blocking in write():
+// records are copied into one of `bufferCount` registered buffers of policy.bufferSize
+// bytes, a full (or flushed) buffer is submitted and the next one is filled while the
+// kernel writes it. The caller only waits when every buffer is still in flight.
+//   logCore->addAppender<UringFileAppender>("app.log");
+// Each buffer goes to an explicit file offset, so only one writer may append to the file.
+// Where io_uring is missing (not Linux, old kernel, disabled by seccomp or sysctl) it is
+// a RawFileAppender with the same policy. So it becomes once a write through the ring
+// fails: that buffer is written synchronously at its offset, then the ring is dropped.
+struct LOG_CC_API UringFileAppender
+{
+    std::string filename;
+    FlushPolicy policy; // bufferSize is per buffer; flush triggers submit, flush() waits
+
+    UringFileAppender(std::string_view filename, FlushPolicy policy = {.bufferSize = 256 << 10}, std::size_t bufferCount = 8);
+    ~UringFileAppender();
+
+    UringFileAppender(const UringFileAppender &)            = delete;
+    UringFileAppender &operator=(const UringFileAppender &) = delete;
+
+    bool isOpen() const;
+    // false when the RawFileAppender fallback is in use
+    bool bUring() const { return ring != nullptr; }
+
+    void operator<<(const MessageElem &elem) { write(std::span<const MessageElem>(&elem, 1)); }
+
+    void write(std::span<const MessageElem> batch);
+    // submits the partial buffer and waits until everything is written
+    void flush();
+    // recycles finished buffers, submits the partial one every policy.flushInterval
+    void poll();
+
+  private:
+    struct Ring; // see uring_file_appender.cpp
+
+    // after a failed write, switches to the fallback for good
+    void leaveRing();
+
+    std::unique_ptr<Ring> ring;
+    RawFileAppender       fallback;
+};
+
+
+TOP_LEVEL_NAMESPACE_END
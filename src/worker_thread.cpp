@@ -0,0 +1,75 @@
+#include "worker_thread.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/resource.h>
+    #include <unistd.h>
+    #if defined(__linux__)
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+bool applyThreadPlacement(const ThreadPlacement &placement)
+{
+    bool bOk = true;
+#ifdef _WIN32
+    if (!placement.cpus.empty()) {
+        DWORD_PTR mask = 0;
+        for (int cpu : placement.cpus) {
+            if (cpu >= 0 && cpu < (int)(sizeof(DWORD_PTR) * 8)) {
+                mask |= (DWORD_PTR)1 << cpu;
+            }
+        }
+        bOk &= ::SetThreadAffinityMask(::GetCurrentThread(), mask) != 0;
+    }
+    int priority = placement.realtimePriority > 0 ? THREAD_PRIORITY_TIME_CRITICAL
+                 : placement.nice > 10            ? THREAD_PRIORITY_LOWEST
+                 : placement.nice > 0             ? THREAD_PRIORITY_BELOW_NORMAL
+                 : placement.nice < -10           ? THREAD_PRIORITY_HIGHEST
+                 : placement.nice < 0             ? THREAD_PRIORITY_ABOVE_NORMAL
+                                                  : THREAD_PRIORITY_NORMAL;
+    if (priority != THREAD_PRIORITY_NORMAL) {
+        bOk &= ::SetThreadPriority(::GetCurrentThread(), priority) != 0;
+    }
+#else
+    #if defined(__linux__)
+    if (!placement.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : placement.cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        bOk &= ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+    }
+    if (placement.nice != 0) {
+        // per thread on Linux: the thread id is a valid PRIO_PROCESS target
+        bOk &= ::setpriority(PRIO_PROCESS, (id_t)::syscall(SYS_gettid), placement.nice) == 0;
+    }
+    #else
+    // no CPU affinity API (macOS only has hints); nice is per process there
+    bOk &= placement.cpus.empty() && placement.nice == 0;
+    #endif
+    if (placement.realtimePriority > 0) {
+        sched_param param{};
+        param.sched_priority = placement.realtimePriority;
+        bOk &= ::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+#endif
+    if (!bOk) {
+        debug("log.cc::applyThreadPlacement"), "could not apply all of the placement";
+    }
+    return bOk;
+}
+
+
+TOP_LEVEL_NAMESPACE_END
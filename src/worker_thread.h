@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #include <emmintrin.h>
+#endif
+
+#include "base.h"
+
+
+
+TOP_LEVEL_NAMESPACE_BEGIN
+
+
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+
+// What the log worker does once its queue runs dry, before it parks (sleeps until a
+// producer signals it); see AsyncLogControl::setWaitStrategy(). Producers only pay
+// for a wakeup while the worker is parked.
+struct WaitStrategy
+{
+    static constexpr std::uint32_t NeverPark = UINT32_MAX;
+
+    std::uint32_t             spins  = 64;  // busy polls
+    std::uint32_t             yields = 64;  // polls with std::this_thread::yield() in between
+    std::uint32_t             sleeps = 0;   // polls with `sleep` in between; NeverPark = poll until pollInterval
+    std::chrono::microseconds sleep{100};
+
+    // Polls `bReady` in the phases above until it holds or `deadline` passes.
+    // Returns false when it is time to park (or the deadline passed).
+    template <typename Ready>
+    bool poll(std::chrono::steady_clock::time_point deadline, Ready &&bReady) const
+    {
+        for (std::uint32_t i = 0; i < spins; ++i) {
+            if (bReady()) {
+                return true;
+            }
+            cpuRelax();
+        }
+        for (std::uint32_t i = 0; i < yields; ++i) {
+            if (bReady()) {
+                return true;
+            }
+            std::this_thread::yield();
+        }
+        for (std::uint32_t i = 0; sleeps == NeverPark || i < sleeps; ++i) {
+            if (bReady()) {
+                return true;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(sleep, deadline - now));
+        }
+        return bReady();
+    }
+};
+
+
+// Sleeping side of a single consumer queue. A producer calls wake() after publishing,
+// which is a fence and a load unless the consumer is inside park().
+struct Parker
+{
+    void wake()
+    {
+        // pairs with the fence in park(): either we see bParked or the consumer sees our element
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (bParked.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cv.notify_one();
+        }
+    }
+
+    // for shutdown
+    void wakeAll()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_all();
+    }
+
+    // consumer: sleeps until `bReady()` or `deadline`
+    template <typename Ready>
+    void park(std::chrono::steady_clock::time_point deadline, Ready &&bReady)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        bParked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv.wait_until(lock, deadline, bReady);
+        bParked.store(false, std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<bool>       bParked{false};
+    std::mutex              mutex;
+    std::condition_variable cv;
+};
+
+
+// Where the log worker runs, see AsyncLogControl::setWorkerPlacement()
+struct ThreadPlacement
+{
+    std::vector<int> cpus;     // CPUs the thread may run on, empty = any
+    int              nice = 0; // > 0 lowers, < 0 raises the priority (may need privileges)
+    // SCHED_FIFO priority 1..99 on Linux / THREAD_PRIORITY_TIME_CRITICAL on Windows, 0 = keep the normal scheduler
+    int realtimePriority = 0;
+};
+
+// Applies `placement` to the calling thread; false (with a debug line) if part of it failed
+extern LOG_CC_API bool applyThreadPlacement(const ThreadPlacement &placement);
+
+
+TOP_LEVEL_NAMESPACE_END
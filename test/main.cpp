@@ -1,9 +1,84 @@
 #include "log.cc/log.h"
 
+#include <atomic>
+#include <filesystem>
 #include <format>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
 
 #define FMT(fmt, ...) std::format(fmt __VA_OPT__(, )##__VA_ARGS__)
 
+
+// Captures what a ConsoleAppender writes to an fd (setFds()); holds up to the pipe buffer, 64KB
+struct Pipe
+{
+    int readFd  = -1;
+    int writeFd = -1;
+
+    Pipe()
+    {
+        int fds[2] = {-1, -1};
+#ifdef _WIN32
+        ::_pipe(fds, 1 << 16, _O_BINARY);
+#else
+        if (::pipe(fds) != 0) {
+            fds[0] = fds[1] = -1;
+        }
+#endif
+        readFd  = fds[0];
+        writeFd = fds[1];
+    }
+    ~Pipe()
+    {
+        closeFd(readFd);
+        closeFd(writeFd);
+    }
+
+    Pipe(const Pipe &)            = delete;
+    Pipe &operator=(const Pipe &) = delete;
+
+    // Everything written so far; closes the write end, so call once the writer is done
+    std::string drain()
+    {
+        closeFd(writeFd);
+        std::string ret;
+        char        buffer[4096];
+        for (;;) {
+#ifdef _WIN32
+            int n = ::_read(readFd, buffer, sizeof(buffer));
+#else
+            ssize_t n = ::read(readFd, buffer, sizeof(buffer));
+#endif
+            if (n <= 0) {
+                return ret;
+            }
+            ret.append(buffer, (std::size_t)n);
+        }
+    }
+
+  private:
+    static void closeFd(int &fd)
+    {
+        if (fd >= 0) {
+#ifdef _WIN32
+            ::_close(fd);
+#else
+            ::close(fd);
+#endif
+            fd = -1;
+        }
+    }
+};
+
 int foo()
 {
     using namespace logcc;
@@ -73,10 +148,1160 @@ int bar()
     return 0;
 }
 
+int lockFreeQueue(bool bThreadLocal)
+{
+    using namespace logcc;
+
+    constexpr int Producers   = 4;
+    constexpr int PerProducer = 1000;
+    const char   *filename    = bThreadLocal ? "test_thread_local.log" : "test_lock_free.log";
+    std::remove(filename);
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->addFileAppender(filename);
+        logCore->consoleAppender.setFds(-1, -1);
+        if (bThreadLocal) {
+            logCore->useThreadLocalQueues(16);
+        }
+        else {
+            logCore->useLockFreeQueue(1024);
+        }
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        logger.setFormatter(CategoryFormatter{.category = bThreadLocal ? "thread-local" : "lock-free"});
+
+        std::vector<std::thread> producers;
+        for (int i = 0; i < Producers; ++i) {
+            producers.emplace_back([&logger, i]() {
+                for (int j = 0; j < PerProducer; ++j) {
+                    logger.log(LogLevel::Info, FMT("producer {} msg {}", i, j));
+                }
+            });
+        }
+        for (auto &producer : producers) {
+            producer.join();
+        }
+    }
+
+    // every record exactly once, each producer's in the order it logged them
+    // (the thread-local rings are merged by timestamp)
+    std::ifstream    in(filename);
+    std::string      line;
+    std::vector<int> seen(Producers * PerProducer);
+    int              next[Producers]{};
+    bool             bOk = true;
+    while (std::getline(in, line)) {
+        int         producer = -1, msg = -1;
+        std::size_t pos = line.find("producer ");
+        if (pos == std::string::npos || std::sscanf(line.c_str() + pos, "producer %d msg %d", &producer, &msg) != 2 ||
+            producer < 0 || producer >= Producers || msg < 0 || msg >= PerProducer)
+        {
+            bOk = false;
+            continue;
+        }
+        ++seen[producer * PerProducer + msg];
+        bOk &= msg == next[producer]++;
+    }
+    bOk &= std::all_of(seen.begin(), seen.end(), [](int count) { return count == 1; });
+    printf("%s queue: %s\n", bThreadLocal ? "thread-local" : "lock-free", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int deferred()
+{
+    using namespace logcc;
+
+    std::remove("test_deferred.log");
+    std::string owned = "owned string";
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->addFileAppender("test_deferred.log");
+        logCore->consoleAppender.setFds(-1, -1);
+        logCore->setTimePrecision(ETimePrecision::Micro);
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        logger.setFormatter(CategoryFormatter{.category = "deferred"});
+        logger.config.setLogDetailLevel(Config::NoDetail);
+
+        logger.logDeferred(LogLevel::Info, "int {} double {:.2f}", 1, 2.5);
+        logger.logDeferred(LogLevel::Warn, "{} / {} / {}", owned, std::string_view("view"), "literal");
+        // three strings and seven ints do not fit the inline storage
+        logger.logDeferred(LogLevel::Error, "{} {} {} {} {} {} {} {} {} {}", owned, owned, owned, 1, 2, 3, 4, 5, 6, 7);
+        // the arguments were copied: changing them after the call does not show
+        owned = "changed";
+    }
+
+    // "2024-01-02 03:04:05.123456 " then the record, formatted on the worker
+    const char *expected[] = {
+        "[Info]\tdeferred int 1 double 2.50",
+        "[Warn]\tdeferred owned string / view / literal",
+        "[Error]\tdeferred owned string owned string owned string 1 2 3 4 5 6 7",
+    };
+    std::ifstream in("test_deferred.log");
+    std::string   line;
+    std::size_t   lines = 0;
+    bool          bOk   = true;
+    while (std::getline(in, line)) {
+        bOk &= lines < std::size(expected) && line.size() > 27 && line[26] == ' ' && line.substr(27) == expected[lines];
+        ++lines;
+    }
+    bOk &= lines == std::size(expected);
+    // the last set really took the heap path, the first stayed inline
+    std::string str = "owned string";
+    bOk &= DeferredArgs::capture(1, 2.5).heapBytes() == 0;
+    bOk &= DeferredArgs::capture(str, str, str, 1, 2, 3, 4, 5, 6, 7).heapBytes() > DeferredArgs::InlineSize;
+    printf("deferred: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int typedApi()
+{
+    using namespace logcc;
+
+    auto logCore = std::make_shared<AsyncLogControl>();
+    logCore->run();
+
+    AsyncLogger logger(logCore);
+    logger.info("typed async {} {}", 1, "x");
+    logger.error("typed async {:>4}", 42);
+
+    // once written, record buffers come back to the producers instead of being freed
+    for (int i = 0; i < 100; ++i) {
+        logger.info("typed async recycled buffer {}", i);
+    }
+    bool bRecycled = false;
+    for (int wait = 0; wait < 200 && !bRecycled; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        bRecycled = logCore->bufferPool.take(0).capacity() > std::string().capacity();
+    }
+    printf("typed async buffers recycled: %s\n", bRecycled ? "ok" : "FAILED");
+
+    SyncLogger syncLogger;
+    syncLogger.setFormatter(CategoryFormatter{.category = "typed"});
+    syncLogger.debug("typed sync {}", 1.5);
+    syncLogger.warn("typed sync {}", std::string("str"));
+
+    // no appendPrefix(): goes through the string_view formatter
+    syncLogger.setFormatter([](const Config &, std::string &output, LogLevel::T, std::string_view msg, const std::source_location &) {
+        output = std::format("custom: {}\n", msg);
+        return true;
+    });
+    syncLogger.info("typed sync {}", 2);
+
+    return bRecycled ? 0 : 1;
+}
+
+int pattern()
+{
+    using namespace logcc;
+
+    const Config         config{};
+    std::source_location here = std::source_location::current();
+    std::string          output;
+    bool                 bOk   = true;
+    auto                 check = [&bOk](const char *what, const std::string &got, const std::string &expected) {
+        if (got != expected) {
+            printf("pattern %s: got \"%s\", expected \"%s\"\n", what, got.c_str(), expected.c_str());
+            bOk = false;
+        }
+    };
+
+    PatternFormatter<"[%l] %n %s:%# %v"> located{.name = "pattern"};
+    std::string                          expected = std::format("[Info] pattern {}:{} msg\n", here.file_name(), here.line());
+    located(config, output, LogLevel::Info, "msg", here);
+    check("%n %s %#", output, expected);
+    // typed calls: the prefix, then the message appended in place
+    output.clear();
+    located.appendPrefix(config, output, LogLevel::Info, here);
+    output += "msg\n";
+    check("prefix", output, expected);
+
+    // message not last: no appendPrefix(), typed calls take the fallback
+    static_assert(PrefixFormatter<decltype(located)>);
+    static_assert(!PrefixFormatter<PatternFormatter<"%L %v (%!) 100%%">>);
+    PatternFormatter<"%L %v (%!) 100%%">{}(config, output, LogLevel::Error, "typed 2", here);
+    check("%! %%", output, std::format("E typed 2 ({}) 100%\n", here.function_name()));
+
+    // the constexpr level tables, through %l %L %^ %$, against the maps they replaced
+    struct
+    {
+        LogLevel::T level;
+        const char *expected;
+    } levels[] = {
+        {LogLevel::Debug, "DEBUG D \033[36mx\033[0m\n"},
+        {LogLevel::Trace, "TRACE T \033[37mx\033[0m\n"},
+        {LogLevel::Info, "Info I \033[32mx\033[0m\n"},
+        {LogLevel::Warn, "WARN W \033[33mx\033[0m\n"},
+        {LogLevel::Error, "ERROR E \033[31mx\033[0m\n"},
+        {LogLevel::Fatal, "FATAL F \033[31mx\033[0m\n"},
+    };
+    for (const auto &[level, text] : levels) {
+        PatternFormatter<"%l %L %^%v%$">{}(config, output, level, "x", here);
+        check("level", output, text);
+        check("level map", output,
+              std::format("{} {} {}x{}\n", LogLevel::level2Strings.at(level), LogLevel::level2CompatLevelStrings.at(level),
+                          LogLevel::level2TerminalColorCode.at(level), LogLevel::color2TerminalColorCode.at(LogLevel::Reset)));
+    }
+
+    // %T: "2024-01-02 03:04:05.123456", the time of the log call or of a RecordTimeScope around it
+    PatternFormatter<"%T|%v"> timed{};
+    timed(config, output, LogLevel::Info, "t", here);
+    bool bShape = output.size() == 26 + 3 && output.ends_with("|t\n");
+    for (std::size_t i = 0; bShape && i < 26; ++i) {
+        char sep = i == 4 || i == 7 ? '-' : i == 10 ? ' ' : i == 13 || i == 16 ? ':' : i == 19 ? '.' : '\0';
+        bShape = sep ? output[i] == sep : output[i] >= '0' && output[i] <= '9';
+    }
+    check("%T", bShape ? "shape ok" : output, "shape ok");
+    {
+        // a day back, mid-second so the rendering does not depend on which anchor converts it
+        TimestampFormatter formatter;
+        std::int64_t       tick = timestampNow() - 86'400'000'000'000;
+        tick += 500'000'000 - formatter.toWallNs(tick) % 1'000'000'000;
+        std::string earlier;
+        formatter.append(earlier, tick, ETimePrecision::Second);
+        RecordTimeScope scope(tick);
+        timed(config, output, LogLevel::Info, "t", here);
+        check("%T scope", output.substr(0, 19), earlier);
+    }
+
+    printf("pattern formatter: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int staticLogger()
+{
+    using namespace logcc;
+
+    std::remove("test_static.log");
+    Pipe console;
+    {
+        ConsoleAppender consoleAppender;
+        consoleAppender.setFds(console.writeFd, -1);
+        consoleAppender.setColor(false);
+
+        Logger<PatternFormatter<"[%l] %n %v">, ConsoleAppender, FileAppender> logger({.name = "static"}, std::move(consoleAppender),
+                                                                                      FileAppender("test_static.log"));
+        logger.info("static {}", 1);
+        logger.log(LogLevel::Error, "static string_view");
+        logger.config.setLogLevel(LogLevel::Warn);
+        logger.info("static filtered {}", 2);
+        logger.sink<FileAppender>().flush();
+    }
+
+    // every sink got each record once, in order, and nothing below the level
+    const std::string expected = "[Info] static static 1\n"
+                                 "[ERROR] static static string_view\n";
+    std::ifstream     in("test_static.log");
+    std::string       file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string       text = console.drain();
+    bool              bOk  = file == expected && text == expected;
+    printf("static logger sinks: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int rawFileAppender()
+{
+    using namespace logcc;
+    using namespace std::chrono_literals;
+
+    auto readLines = [](const char *filename) {
+        std::vector<std::string> ret;
+        std::ifstream            in(filename);
+        for (std::string line; std::getline(in, line);) {
+            ret.push_back(std::move(line));
+        }
+        return ret;
+    };
+    // "raw file 0" .. "raw file <count - 1>", nothing else
+    auto bSequence = [](const std::vector<std::string> &lines, std::size_t count) {
+        bool bOk = lines.size() == count;
+        for (std::size_t i = 0; bOk && i < count; ++i) {
+            bOk = lines[i] == std::format("raw file {}", i);
+        }
+        return bOk;
+    };
+
+    // Each trigger on its own: `records` records (the last one at `lastLevel`), then the lines
+    // on disk before the destructor flushes the rest; "raw file 0".."raw file 9" are 11 bytes
+    struct Case
+    {
+        const char *name;
+        FlushPolicy policy;
+        std::size_t records;
+        LogLevel::T lastLevel;
+        std::size_t onDisk;
+    };
+    const Case cases[] = {
+        {"buffered", {.flushInterval = 0ms}, 50, LogLevel::Info, 0},
+        {"flushLevel", {.flushInterval = 0ms}, 51, LogLevel::Error, 51},
+        {"flushLevel warn", {.flushInterval = 0ms, .flushLevel = LogLevel::Warn}, 4, LogLevel::Warn, 4},
+        {"flushRecords", {.flushRecords = 100, .flushInterval = 0ms}, 250, LogLevel::Info, 200},
+        {"flushBytes", {.flushBytes = 55, .flushInterval = 0ms}, 7, LogLevel::Info, 5},
+        {"bufferSize", {.bufferSize = 64, .flushInterval = 0ms}, 11, LogLevel::Info, 10},
+        {"bSync", {.flushRecords = 1, .flushInterval = 0ms, .bSync = true}, 3, LogLevel::Info, 3},
+    };
+    bool bOk = true;
+    for (const Case &c : cases) {
+        std::remove("test_raw.log");
+        std::size_t onDisk = 0;
+        {
+            RawFileAppender appender("test_raw.log", c.policy);
+            for (std::size_t i = 0; i < c.records; ++i) {
+                appender << MessageElem{.level = i + 1 == c.records ? c.lastLevel : LogLevel::Info, .msg = std::format("raw file {}\n", i)};
+            }
+            onDisk = readLines("test_raw.log").size();
+        }
+        bool bCase = onDisk == c.onDisk && bSequence(readLines("test_raw.log"), c.records);
+        if (!bCase) {
+            printf("raw file %s: %zu lines on disk, expected %zu\n", c.name, onDisk, c.onDisk);
+        }
+        bOk &= bCase;
+    }
+
+    // the time trigger fires from poll()
+    std::remove("test_raw.log");
+    {
+        RawFileAppender appender("test_raw.log", FlushPolicy{.flushInterval = 1ms});
+        appender << MessageElem{.level = LogLevel::Info, .msg = "raw file 0\n"};
+        std::this_thread::sleep_for(5ms);
+        appender.poll();
+        bOk &= bSequence(readLines("test_raw.log"), 1);
+    }
+
+    // and behind the async worker
+    std::remove("test_raw.log");
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->addAppender<RawFileAppender>("test_raw.log", FlushPolicy{.bufferSize = 64 * 1024, .flushRecords = 100, .bSync = true});
+        logCore->consoleAppender.setFds(-1, -1);
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        logger.setFormatter([](const Config &, std::string &output, LogLevel::T, std::string_view msg, const std::source_location &) {
+            output = std::format("{}\n", msg);
+            return true;
+        });
+        for (int i = 0; i < 200; ++i) {
+            logger.info("raw file {}", i);
+        }
+        logger.error("raw file {}", 200);
+    }
+    bOk &= bSequence(readLines("test_raw.log"), 201);
+    printf("raw file appender: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int rotatingFileAppender()
+{
+    using namespace logcc;
+    namespace fs = std::filesystem;
+
+    // numbering continues from segments left by earlier runs: start clean
+    auto segmentsOnDisk = []() {
+        std::vector<std::pair<std::uint64_t, std::string>> ret;
+        std::error_code                                    ec;
+        for (const auto &entry : fs::directory_iterator(".", ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.starts_with("test_rotating.log.")) {
+                ret.emplace_back(std::stoull(name.substr(sizeof("test_rotating.log.") - 1)), name);
+            }
+        }
+        std::sort(ret.begin(), ret.end());
+        return ret;
+    };
+    for (const auto &[seq, name] : segmentsOnDisk()) {
+        std::remove(name.c_str());
+    }
+    std::remove("test_rotating.log");
+
+    constexpr std::size_t MaxBytes = 4096;
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->addAppender<RotatingFileAppender>("test_rotating.log", RotationPolicy{.maxBytes = MaxBytes, .maxSegments = 3, .bCompress = true});
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        for (int i = 0; i < 1000; ++i) {
+            logger.info("rotating file {}", i);
+        }
+    }
+
+    // rotation happens between records, once the file has reached maxBytes
+    std::uint64_t rotations = 0;
+    std::size_t   size      = 0;
+    for (int i = 0; i < 1000; ++i) {
+        if (size >= MaxBytes) {
+            ++rotations;
+            size = 0;
+        }
+        size += std::format("[Info]\trotating file {}\n", i).size();
+    }
+    rotations += size >= MaxBytes;
+
+    // only the newest 3 segments are kept; uncompressed ones (no zlib) hold whole records
+    auto segments = segmentsOnDisk();
+    bool bOk      = rotations > 3 && segments.size() == 3;
+    for (std::size_t i = 0; bOk && i < segments.size(); ++i) {
+        bOk &= segments[i].first == rotations - 2 + i;
+        if (!segments[i].second.ends_with(".gz")) {
+            std::uintmax_t bytes = fs::file_size(segments[i].second);
+            bOk &= bytes >= MaxBytes && bytes < MaxBytes + 32;
+        }
+    }
+    std::ifstream in("test_rotating.log");
+    std::string   line, last;
+    while (std::getline(in, line)) {
+        last = line;
+    }
+    bOk &= last == "[Info]\trotating file 999";
+    printf("rotating file: %llu rotations, %zu segments kept %s\n", (unsigned long long)rotations, segments.size(), bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int mmapFileAppender()
+{
+    using namespace logcc;
+
+    {
+        // what a crashed writer leaves behind: the preallocated tail is still zeros
+        std::ofstream seed("test_mmap.log", std::ios::binary | std::ios::trunc);
+        seed << "before the crash\n" << std::string(8192, '\0');
+    }
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->addAppender<MmapFileAppender>("test_mmap.log", 4096);
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        for (int i = 0; i < 500; ++i) {
+            logger.info("mmap file {}", i);
+        }
+    }
+
+    std::ifstream in("test_mmap.log", std::ios::binary);
+    std::string   text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    bool          bOk = text.find('\0') == std::string::npos && text.starts_with("before the crash\n") && std::count(text.begin(), text.end(), '\n') == 501;
+    printf("mmap file after a crash: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int uringFileAppender()
+{
+    using namespace logcc;
+
+    std::remove("test_uring.log");
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        auto &file   = logCore->addAppender<UringFileAppender>("test_uring.log", FlushPolicy{.bufferSize = 4096}, 4);
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        for (int i = 0; i < 2000; ++i) {
+            logger.info("uring file {}", i);
+        }
+        printf("uring: %s\n", file.bUring() ? "io_uring" : "fallback");
+    }
+
+    std::ifstream in("test_uring.log");
+    std::string   line;
+    int           count = 0;
+    while (std::getline(in, line)) {
+        if (line.find(std::format("uring file {}", count)) == std::string::npos) {
+            break;
+        }
+        ++count;
+    }
+    bool bOk = count == 2000 && !std::getline(in, line);
+    printf("uring lines in order: %d %s\n", count, bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int binaryLog()
+{
+    using namespace logcc;
+
+    std::remove("test_binary.log");
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->useBinaryFile("test_binary.log");
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        for (int i = 0; i < 100; ++i) {
+            logger.logBinary(LogLevel::Info, "binary {} {:.2f} {}", i, i * 0.5, "str");
+        }
+        logger.logBinary(LogLevel::Info, "binary null {}", (const char *)nullptr);
+        logger.warn("text record {}", 1);
+    }
+
+    std::ifstream   in("test_binary.log", std::ios::binary);
+    BinaryLogReader reader(in);
+    BinaryLogReader::Record record;
+    int                     count = 0;
+    bool                    bNull = false;
+    while (reader.next(record)) {
+        ++count;
+        bNull |= record.text == "binary null (null)";
+    }
+    bool bOk = count == 102 && bNull && reader.error().empty(); // 100, the null one, the text one
+    printf("binary log: %d records %s%s%s\n", count, bNull ? "" : "no null record ", reader.error().c_str(), bOk ? "ok" : "FAILED");
+
+    // a corrupt level or site id is an error, not an index into the level tables
+    auto corrupt = [](char frame, std::uint32_t first) {
+        std::string bytes(BinaryLog::Magic, sizeof(BinaryLog::Magic));
+        auto        put = [&bytes](const auto &value) { bytes.append((const char *)&value, sizeof(value)); };
+        put(BinaryLog::Version);
+        put(BinaryLog::EndianCheck);
+        bytes.push_back(frame);
+        put(first); // Text: level; Record: site id
+        if (frame == (char)BinaryLog::EFrame::Record) {
+            put((std::uint32_t)LogLevel::Info);
+        }
+        put((std::int64_t)0);
+        put((std::uint32_t)0);
+
+        std::istringstream      in(bytes);
+        BinaryLogReader         reader(in);
+        BinaryLogReader::Record record;
+        return !reader.next(record) && !reader.error().empty();
+    };
+    bool bRejected = corrupt((char)BinaryLog::EFrame::Text, 0) && corrupt((char)BinaryLog::EFrame::Text, 7000) &&
+                     corrupt((char)BinaryLog::EFrame::Text, 250) && corrupt((char)BinaryLog::EFrame::Record, 0);
+    printf("binary log corrupt frames: %s\n", bRejected ? "ok" : "FAILED");
+    bOk &= bRejected;
+
+    return bOk ? 0 : 1;
+}
+
+// addAppender() sink for sinkThreads(): keeps what it was handed, the gated one blocks until the gate opens
+struct CollectSink
+{
+    struct Shared
+    {
+        std::atomic<bool>        bGateOpen = false;
+        std::mutex               mutex;
+        std::vector<std::string> records;
+    };
+
+    Shared &shared;
+    bool    bGated = false;
+
+    void write(std::span<const logcc::MessageElem> batch)
+    {
+        if (bGated) {
+            shared.bGateOpen.wait(false);
+        }
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        for (const auto &elem : batch) {
+            shared.records.push_back(elem.msg);
+        }
+    }
+    void flush() {}
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        return shared.records.size();
+    }
+};
+
+int sinkThreads()
+{
+    using namespace logcc;
+    using namespace std::chrono_literals;
+
+    constexpr std::size_t Records = 1000;
+
+    std::remove("test_sink.log");
+    std::remove("test_sink_raw.log");
+    CollectSink::Shared fast, slow;
+    bool                bOk = true;
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->addFileAppender("test_sink.log");
+        logCore->addAppender<RawFileAppender>("test_sink_raw.log");
+        CollectSink &fastSink = logCore->addAppender<CollectSink>(fast);
+        CollectSink &slowSink = logCore->addAppender<CollectSink>(slow, true);
+        logCore->consoleAppender.setFds(-1, -1);
+        // room for every batch, so the worker never waits on the blocked sink
+        logCore->useSinkThreads(2 * Records);
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        logger.setFormatter([](const Config &, std::string &output, LogLevel::T, std::string_view msg, const std::source_location &) {
+            output = std::format("{}\n", msg);
+            return true;
+        });
+        for (std::size_t i = 0; i < Records; ++i) {
+            logger.logDeferred(LogLevel::Info, "sink thread {}", i);
+        }
+
+        // the other sinks get everything while one is stuck in write()
+        auto deadline = std::chrono::steady_clock::now() + 5s;
+        while (fastSink.size() < Records && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(1ms);
+        }
+        bool bNotHeldUp = fastSink.size() == Records && slowSink.size() == 0;
+        printf("sink threads, slow sink does not hold up the others: %s\n", bNotHeldUp ? "ok" : "FAILED");
+        bOk &= bNotHeldUp;
+
+        slow.bGateOpen = true;
+        slow.bGateOpen.notify_all();
+    }
+
+    // every sink got every record once, in order
+    auto bSequence = [](const std::vector<std::string> &records) {
+        bool bOk = records.size() == Records;
+        for (std::size_t i = 0; bOk && i < Records; ++i) {
+            bOk = records[i] == std::format("sink thread {}\n", i);
+        }
+        return bOk;
+    };
+    auto readLines = [](const char *filename) {
+        std::vector<std::string> ret;
+        std::ifstream            in(filename);
+        for (std::string line; std::getline(in, line);) {
+            ret.push_back(line + '\n');
+        }
+        return ret;
+    };
+    bOk &= bSequence(fast.records) && bSequence(slow.records);
+    bOk &= bSequence(readLines("test_sink.log")) && bSequence(readLines("test_sink_raw.log"));
+    printf("sink threads: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int queueLimit()
+{
+    using namespace logcc;
+
+    std::remove("test_limit.log");
+    std::uint64_t dropped = 0;
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->addFileAppender("test_limit.log");
+        logCore->setQueueLimit(QueueLimit{.capacity = 10, .policy = EOverflowPolicy::DropBelowLevel, .dropBelow = LogLevel::Warn});
+        logCore->dropReportInterval = std::chrono::seconds(0);
+
+        AsyncLogger logger(logCore);
+        // nothing is consumed before run(): the queue fills up
+        for (int i = 0; i < 100; ++i) {
+            logger.info("limited {}", i);
+        }
+        dropped = logCore->droppedCount(LogLevel::Info);
+        logCore->run();
+        logger.error("limited error");
+    }
+    std::ifstream limitIn("test_limit.log");
+    std::string   line;
+    int           kept = 0;
+    while (std::getline(limitIn, line)) {
+        kept += line.find("limited ") != std::string::npos;
+    }
+    bool bOk = dropped == 90 && kept == 11; // the first 10 and the error
+    printf("queue limit: %llu dropped %d kept %s\n", (unsigned long long)dropped, kept, bOk ? "ok" : "FAILED");
+
+    // DropOldest keeps the newest `capacity` records, in order, in `capacity` slots
+    std::remove("test_limit_oldest.log");
+    std::size_t queued = 0;
+    {
+        auto oldestCore = std::make_shared<AsyncLogControl>();
+        oldestCore->addFileAppender("test_limit_oldest.log");
+        oldestCore->setQueueLimit(QueueLimit{.capacity = 10, .policy = EOverflowPolicy::DropOldest});
+
+        AsyncLogger oldest(oldestCore);
+        for (int i = 0; i < 100; ++i) {
+            oldest.info("oldest {}", i);
+        }
+        queued = oldestCore->msgQueue.queue.size();
+        oldestCore->run();
+    }
+    std::ifstream in("test_limit_oldest.log");
+    int           next    = 90;
+    bool          bOldest = queued == 10;
+    while (std::getline(in, line)) {
+        bOldest &= line.ends_with(std::format("oldest {}", next++));
+    }
+    bOldest &= next == 100;
+    printf("queue limit drop oldest: %s\n", bOldest ? "ok" : "FAILED");
+
+    return bOk && bOldest ? 0 : 1;
+}
+
+int rateLimit()
+{
+    using namespace logcc;
+
+    auto logCore = std::make_shared<AsyncLogControl>();
+    logCore->addFileAppender("test_rate.log");
+    logCore->setSuppressDuplicates(true);
+    logCore->run();
+
+    static_assert(std::is_copy_constructible_v<AsyncLogger>, "copies share the rate limit");
+    AsyncLogger logger(logCore);
+    logger.setRateLimit(RateLimit{.perSecond = 1, .burst = 5});
+    for (int i = 0; i < 1000; ++i) {
+        logger.error("hot loop {}", i); // 5 pass, the rest are dropped before formatting
+    }
+    AsyncLogger unlimited(logCore);
+    for (int i = 0; i < 1000; ++i) {
+        unlimited.info("same message"); // written once plus "last message repeated"
+    }
+
+    SyncLogger syncLogger;
+    syncLogger.setRateLimit(RateLimit{.sampleEvery = 100});
+    syncLogger.setSuppressDuplicates(true);
+    for (int i = 0; i < 1000; ++i) {
+        syncLogger.log(LogLevel::Info, "sampled");
+    }
+
+    // the worker's own records follow the control's formatter
+    std::remove("test_repeat_json.log");
+    {
+        auto jsonCore = std::make_shared<AsyncLogControl>();
+        jsonCore->addFileAppender("test_repeat_json.log");
+        jsonCore->setSuppressDuplicates(true);
+        jsonCore->setFormatter(JsonEncoder{});
+
+        AsyncLogger json(jsonCore);
+        json.setFormatter(JsonEncoder{});
+        for (int i = 0; i < 10; ++i) {
+            json.info("same json");
+        }
+        jsonCore->run();
+    }
+    std::ifstream in("test_repeat_json.log");
+    std::string   line;
+    bool          bOk = false;
+    while (std::getline(in, line)) {
+        bOk |= line == R"({"level":"info","msg":"last message repeated","times":9})";
+    }
+    printf("repeat record as json: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int syncThreads()
+{
+    using namespace logcc;
+
+    std::remove("test_sync.log");
+    {
+        SyncLogger logger;
+        logger.fileAppenders.emplace_back("test_sync.log");
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&logger, t]() {
+                for (int i = 0; i < 250; ++i) {
+                    logger.info("sync thread {} record {}", t, i);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    // every record whole, each thread's in the order it wrote them
+    std::ifstream in("test_sync.log");
+    std::string   line;
+    int           lines = 0;
+    int           next[4]{};
+    bool          bOk = true;
+    while (std::getline(in, line)) {
+        ++lines;
+        int t = 0, i = 0;
+        if (std::sscanf(line.c_str(), "[Info]\tsync thread %d record %d", &t, &i) != 2 || t < 0 || t >= 4 ||
+            line != std::format("[Info]\tsync thread {} record {}", t, i) || i != next[t]++)
+        {
+            bOk = false;
+        }
+    }
+    bOk &= lines == 1000;
+    printf("sync threads: %d lines %s\n", lines, bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int callSites()
+{
+    using namespace logcc;
+
+    auto logCore = std::make_shared<AsyncLogControl>();
+    logCore->addFileAppender("test_site.log");
+    logCore->run();
+
+    AsyncLogger logger(logCore);
+    for (int i = 0; i < 3; ++i) {
+        LOG_CC_INFO(logger, "call site {}", i);
+        LOG_CC_WARN(logger, "call site warn {}", i);
+    }
+    LOG_CC_ERROR(logger, "no arguments");
+
+    // the worker's prefix cache lets go of replaced formatters
+    std::weak_ptr<const SitePrefixFunc> first = logger.sitePrefixFormatter;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50)); // the records above are written
+    for (int i = 0; i < 1000; ++i) {
+        logger.setFormatter(DefaultFormatter{});
+        LOG_CC_DEBUG(logger, "formatter {}", i);
+    }
+    for (int wait = 0; wait < 200 && !first.expired(); ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    printf("call site prefix cache: %s\n", first.expired() ? "pruned" : "FAILED, still holds the first formatter");
+
+    SyncLogger syncLogger;
+    LOG_CC_WARN(syncLogger, "sync call site {}", 1);
+
+    Logger<PatternFormatter<"[%l] %s:%# %v">, ConsoleAppender> staticLogger;
+    LOG_CC_INFO(staticLogger, "static call site {}", 2);
+
+    return first.expired() ? 0 : 1;
+}
+
+int categories()
+{
+    using namespace logcc;
+
+    auto &registry = CategoryRegistry::instance();
+    registry.configure("*=info, net=warn");
+
+    SyncLogger logger;
+    logger.setCategory("net");
+    logger.setFormatter(CategoryFormatter{"net"});
+    logger.info("net info, filtered");
+    registry.setLevel("net", LogLevel::Debug);
+    logger.debug("net debug, enabled at runtime");
+
+    // the file is a layer over configure(): removing its lines restores what was there
+    registry.configure("web=trace");
+    std::ofstream("test_levels.conf") << "# levels\n*=warn\ndb=error\nweb=fatal\n";
+    registry.watchFile("test_levels.conf", std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool bOk = registry.get("db").level == LogLevel::Error && registry.get("web").level == LogLevel::Fatal &&
+               registry.get("other").level == LogLevel::Warn;
+    std::ofstream("test_levels.conf") << "db=error\n";
+    std::filesystem::last_write_time("test_levels.conf", std::filesystem::last_write_time("test_levels.conf") + std::chrono::seconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    registry.stopWatching();
+    bOk &= registry.get("db").level == LogLevel::Error && registry.get("web").level == LogLevel::Trace &&
+           registry.get("other").level == LogLevel::Info;
+    printf("levels from file: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int stats()
+{
+    using namespace logcc;
+
+    for (bool bSinkThreads : {false, true}) {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->addFileAppender("test_stats.log");
+        if (bSinkThreads) {
+            logCore->useSinkThreads();
+        }
+        logCore->statsInterval = std::chrono::seconds(1);
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        for (int i = 0; i < 20; ++i) {
+            logger.info("stats record {}", i);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        AsyncLogStats snapshot = logCore->stats();
+        printf("stats: %s\n", snapshot.toString().c_str());
+    }
+
+    // a backlog larger than one batch of the ring (4096)
+    auto logCore = std::make_shared<AsyncLogControl>();
+    logCore->useLockFreeQueue(16384);
+    logCore->consoleAppender.setFds(-1, -1);
+    AsyncLogger logger(logCore);
+    for (int i = 0; i < 10000; ++i) {
+        logger.info("backlog {}", i);
+    }
+    logCore->run();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::uint64_t highWater = logCore->stats().queueHighWater;
+    printf("stats high-water: %llu\n", (unsigned long long)highWater);
+
+    return highWater == 10000 ? 0 : 1;
+}
+
+int console()
+{
+    using namespace logcc;
+
+    // 0: default (a pipe is no terminal), 1: setColor(false), 2: setColor(true)
+    bool bOk = true;
+    for (int color = 0; color < 3; ++color) {
+        Pipe out, err;
+        {
+            auto logCore             = std::make_shared<AsyncLogControl>();
+            logCore->consoleAppender = ConsoleAppender(LogLevel::Warn);
+            logCore->consoleAppender.setFds(out.writeFd, err.writeFd);
+            if (color > 0) {
+                logCore->consoleAppender.setColor(color == 2);
+            }
+            logCore->run();
+
+            AsyncLogger logger(logCore);
+            logger.setFormatter([](const Config &, std::string &output, LogLevel::T, std::string_view msg, const std::source_location &) {
+                output = std::format("{}\n", msg);
+                return true;
+            });
+            logger.trace("console trace");
+            logger.info("console info");
+            logger.warn("console warn");
+            logger.error("console error");
+        }
+
+        // below stderrLevel to stdout, the rest to stderr; colored records are wrapped whole
+        std::string expectedOut = "console trace\nconsole info\n";
+        std::string expectedErr = "console warn\nconsole error\n";
+        if (color == 2) {
+            expectedOut = "\033[37mconsole trace\n\033[0m\033[32mconsole info\n\033[0m";
+            expectedErr = "\033[33mconsole warn\n\033[0m\033[31mconsole error\n\033[0m";
+        }
+        std::string gotOut = out.drain();
+        std::string gotErr = err.drain();
+        if (gotOut != expectedOut || gotErr != expectedErr) {
+            printf("console color mode %d: unexpected stdout \"%s\" / stderr \"%s\"\n", color, gotOut.c_str(), gotErr.c_str());
+            bOk = false;
+        }
+    }
+    printf("console: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int structured()
+{
+    using namespace logcc;
+
+    bool bOk = true;
+    auto check = [&bOk](const char *what, const std::string &got, std::string_view expected) {
+        if (got != expected) {
+            printf("structured %s: got %s expected %.*s\n", what, got.c_str(), (int)expected.size(), expected.data());
+            bOk = false;
+        }
+    };
+
+    std::string escaped;
+    appendEscaped(escaped, "0123456789abcdef \"quoted\" back\\slash\ttab\x01 0123456789abcdef");
+    check("escaped", escaped, R"(0123456789abcdef \"quoted\" back\\slash\ttab\u0001 0123456789abcdef)");
+
+    // appendEscaped() scans 16 / 32 bytes at a time: compare it with a byte at a time
+    // around the block edges, and on inputs too short for a block
+    auto escapeBytewise = [](std::string_view str) {
+        std::string ret;
+        for (unsigned char c : str) {
+            switch (c) {
+            case '"': ret += "\\\""; break;
+            case '\\': ret += "\\\\"; break;
+            case '\n': ret += "\\n"; break;
+            case '\r': ret += "\\r"; break;
+            case '\t': ret += "\\t"; break;
+            case '\b': ret += "\\b"; break;
+            case '\f': ret += "\\f"; break;
+            default:
+                if (c < 0x20) {
+                    ret += std::format("\\u{:04x}", c);
+                }
+                else {
+                    ret += (char)c;
+                }
+            }
+        }
+        return ret;
+    };
+    for (std::size_t length : {7, 40, 64, 70}) {
+        for (std::size_t offset : {0, 15, 16, 31, 32}) {
+            for (char special : {'"', '\\', '\n', '\x01', '\x1f', '\t'}) {
+                if (offset >= length) {
+                    continue;
+                }
+                std::string input(length, 'a');
+                input[offset]     = special;
+                input[length - 1] = '"';
+                escaped.clear();
+                appendEscaped(escaped, input);
+                check("escaped at an offset", escaped, escapeBytewise(input));
+            }
+        }
+    }
+    std::string mixed;
+    for (int i = 0; i < 100; ++i) {
+        mixed += (char)(i % 3 == 0 ? i % 0x20 : "\"\\xy"[i % 4]);
+    }
+    escaped.clear();
+    appendEscaped(escaped, mixed);
+    check("escaped mixed", escaped, escapeBytewise(mixed));
+
+    std::string                name = "ann \"a\"";
+    const Field                fields[] = {{"user", name}, {"user_id", 42u}, {"latency_us", 12.5}, {"token", nullptr},
+                                           {"session", (const char *)nullptr}, {"admin", false}, {"delta", -3}};
+    const Config               noDetail{.logDetailLevel = Config::NoDetail};
+    const std::source_location here = std::source_location::current();
+    std::string                encoded;
+    JsonEncoder{.category = "auth"}.encode(noDetail, encoded, LogLevel::Info, "login\n", fields, here);
+    check("json", encoded,
+          R"({"level":"info","category":"auth","msg":"login\n","user":"ann \"a\"","user_id":42,"latency_us":12.5,"token":null,"session":null,"admin":false,"delta":-3})"
+          "\n");
+    encoded.clear();
+    LogfmtEncoder{}.encode(noDetail, encoded, LogLevel::Warn, "slow query", fields, here);
+    check("logfmt", encoded,
+          R"(level=warn msg="slow query" user="ann \"a\"" user_id=42 latency_us=12.5 token=null session=null admin=false delta=-3)"
+          "\n");
+    encoded.clear();
+    JsonEncoder{}(Config{}, encoded, LogLevel::Error, "plain record 1", here);
+    check("json with location", encoded, std::format(R"({{"level":"error","msg":"plain record 1","file":"{}","line":{}}})"
+                                                     "\n",
+                                                     here.file_name(), here.line()));
+    encoded.clear();
+    LogfmtEncoder{.category = "db"}(noDetail, encoded, LogLevel::Info, "plain", here);
+    check("logfmt plain", encoded, "level=info category=db msg=plain\n");
+    printf("structured encoders: %s\n", bOk ? "ok" : "FAILED");
+
+
+    SyncLogger logger;
+    logger.log(LogLevel::Info, "login", {{"user", name}, {"user_id", 42}, {"latency_us", 12.5}, {"admin", false}});
+
+    logger.setFormatter(JsonEncoder{.category = "auth"});
+    logger.log(LogLevel::Info, "login", {{"user", name}, {"user_id", 42u}, {"latency_us", 12.5}, {"token", nullptr}, {"session", (const char *)nullptr}});
+    logger.error("plain record {}", 1);
+
+    auto logCore = std::make_shared<AsyncLogControl>();
+    logCore->run();
+    AsyncLogger asyncLogger(logCore);
+    asyncLogger.setFormatter(LogfmtEncoder{});
+    asyncLogger.log(LogLevel::Warn, "slow query", {{"table", "users"}, {"ms", 250}});
+
+    return bOk ? 0 : 1;
+}
+
+int waitStrategy()
+{
+    using namespace logcc;
+    using namespace std::chrono_literals;
+
+    bool bOk = true;
+    for (int queue = 0; queue < 3; ++queue) {
+        CollectSink::Shared delivered;
+        {
+            auto logCore = std::make_shared<AsyncLogControl>();
+            if (queue == 1) {
+                logCore->useLockFreeQueue(256);
+            }
+            else if (queue == 2) {
+                logCore->useThreadLocalQueues(256);
+            }
+            CollectSink &sink = logCore->addAppender<CollectSink>(delivered);
+            logCore->consoleAppender.setFds(-1, -1);
+            logCore->setWaitStrategy({.spins = 16, .yields = 16, .sleeps = 4, .sleep = std::chrono::microseconds(50)});
+            logCore->setWorkerPlacement({.cpus = {0}, .nice = 1});
+            // a parked worker that times out would only look again after 10s:
+            // a record within the bound below means the producer woke it
+            logCore->pollInterval = 10s;
+            logCore->run();
+
+            AsyncLogger logger(logCore);
+            for (std::size_t i = 0; i < 5; ++i) {
+                std::this_thread::sleep_for(20ms); // the worker parks in between
+                logger.info("wait strategy queue {} record {}", queue, i);
+
+                auto deadline = std::chrono::steady_clock::now() + 2s;
+                while (sink.size() <= i && std::chrono::steady_clock::now() < deadline) {
+                    std::this_thread::sleep_for(1ms);
+                }
+                if (sink.size() != i + 1) {
+                    printf("wait strategy queue %d: record %zu not delivered within 2s\n", queue, i);
+                    bOk = false;
+                    break;
+                }
+            }
+        }
+    }
+    printf("wait strategy, parked worker wakes up: %s\n", bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
+int flightRecorder()
+{
+    using namespace logcc;
+
+    std::remove("test_flight.log");
+    {
+        auto logCore = std::make_shared<AsyncLogControl>();
+        logCore->addFileAppender("test_flight.log");
+        logCore->useFlightRecorder({.below = LogLevel::Info, .trigger = LogLevel::Error, .maxRecords = 4});
+        logCore->run();
+
+        AsyncLogger logger(logCore);
+        for (int i = 0; i < 10; ++i) {
+            logger.logDeferred(LogLevel::Debug, "flight debug {}", i);
+        }
+        logger.info("flight info");
+        logger.error("flight error");
+        logger.debug("flight debug after the error, never written");
+    }
+
+    std::ifstream in("test_flight.log");
+    std::string   line;
+    int           count = 0;
+    while (std::getline(in, line)) {
+        ++count;
+    }
+    bool bOk = count == 7; // info, header, debug 6..9, error
+    printf("flight recorder lines: %d %s\n", count, bOk ? "ok" : "FAILED");
+
+    return bOk ? 0 : 1;
+}
+
 int main()
 {
-    foo();
-    bar();
+    int failures = 0;
+    failures += foo() != 0;
+    failures += bar() != 0;
+    failures += lockFreeQueue(false) != 0;
+    failures += lockFreeQueue(true) != 0;
+    failures += deferred() != 0;
+    failures += typedApi() != 0;
+    failures += pattern() != 0;
+    failures += staticLogger() != 0;
+    failures += rawFileAppender() != 0;
+    failures += rotatingFileAppender() != 0;
+    failures += mmapFileAppender() != 0;
+    failures += uringFileAppender() != 0;
+    failures += binaryLog() != 0;
+    failures += sinkThreads() != 0;
+    failures += queueLimit() != 0;
+    failures += rateLimit() != 0;
+    failures += syncThreads() != 0;
+    failures += callSites() != 0;
+    failures += categories() != 0;
+    failures += stats() != 0;
+    failures += console() != 0;
+    failures += structured() != 0;
+    failures += waitStrategy() != 0;
+    failures += flightRecorder() != 0;
 
-    return 0;
-}
\ No newline at end of file
+    if (failures > 0) {
+        printf("%d checks FAILED\n", failures);
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+#include "log.cc/log.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// log.cc.decode [--category <name>] [--detail-level <level>] [--time <none|s|ms|us|ns>] <file>...
+// Prints the records of binary logs (AsyncLogControl::useBinaryFile()) as the
+// DefaultFormatter / CategoryFormatter would have written them.
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: log.cc.decode [options] <file>...\n"
+                 "  --category <name>       prefix records like CategoryFormatter{name}\n"
+                 "  --detail-level <level>  debug|trace|info|warn|error|fatal, records at or above get file:line (default warn)\n"
+                 "  --time <precision>      none|s|ms|us|ns (default ms)\n");
+}
+
+static bool parseLevel(std::string_view str, logcc::LogLevel::T &level)
+{
+    using namespace logcc;
+    constexpr std::string_view names[LogLevel::Count] = {"debug", "trace", "info", "warn", "error", "fatal"};
+    for (std::size_t i = 0; i < LogLevel::Count; ++i) {
+        if (str == names[i]) {
+            level = (LogLevel::T)((i + 1) * 100);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parsePrecision(std::string_view str, logcc::ETimePrecision &precision)
+{
+    using logcc::ETimePrecision;
+    if (str == "none") precision = ETimePrecision::None;
+    else if (str == "s") precision = ETimePrecision::Second;
+    else if (str == "ms") precision = ETimePrecision::Milli;
+    else if (str == "us") precision = ETimePrecision::Micro;
+    else if (str == "ns") precision = ETimePrecision::Nano;
+    else return false;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    using namespace logcc;
+
+    Config            config;
+    CategoryFormatter categoryFormatter;
+    DefaultFormatter  defaultFormatter;
+    bool              bCategory = false;
+    ETimePrecision    precision = ETimePrecision::Milli;
+    std::vector<std::string_view> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg   = argv[i];
+        const char      *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--category" && value) {
+            categoryFormatter.category = value;
+            bCategory                  = true;
+            ++i;
+        }
+        else if (arg == "--detail-level" && value && parseLevel(value, config.logDetailLevel)) {
+            ++i;
+        }
+        else if (arg == "--time" && value && parsePrecision(value, precision)) {
+            ++i;
+        }
+        else if (arg.starts_with("-")) {
+            usage();
+            return 2;
+        }
+        else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        usage();
+        return 2;
+    }
+
+    TimestampFormatter      timestampFormatter;
+    BinaryLogReader::Record record;
+    std::string             output;
+    int                     ret = 0;
+    for (std::string_view file : files) {
+        std::ifstream in(std::string(file), std::ios::binary);
+        if (!in) {
+            std::fprintf(stderr, "log.cc.decode: cannot open %.*s\n", (int)file.size(), file.data());
+            ret = 1;
+            continue;
+        }
+
+        BinaryLogReader reader(in);
+        while (reader.next(record)) {
+            output.clear();
+            if (precision != ETimePrecision::None) {
+                timestampFormatter.appendWall(output, record.wallNs, precision);
+                output.push_back(' ');
+            }
+            if (record.site) {
+                if (bCategory) {
+                    categoryFormatter.appendPrefix(config, output, record.level, record.site->file, record.site->line);
+                }
+                else {
+                    defaultFormatter.appendPrefix(config, output, record.level, record.site->file, record.site->line);
+                }
+                output += record.text;
+                output.push_back('\n');
+            }
+            else {
+                output += record.text; // already formatted by the logger, '\n' included
+            }
+            std::cout.write(output.data(), (std::streamsize)output.size());
+        }
+        if (!reader.error().empty()) {
+            std::fprintf(stderr, "log.cc.decode: %.*s: %s\n", (int)file.size(), file.data(), reader.error().c_str());
+            ret = 1;
+        }
+    }
+    return ret;
+}
@@ -1,6 +1,27 @@
 --print("Check if did not add 'fmt' packages in your toplevel xmake.lua")
 
 add_cxflags("/Zc:preprocessor")
+
+option("zlib")
+do
+    set_default(false)
+    set_showmenu(true)
+    set_description("Compress rotated log segments (RotatingFileAppender) with zlib")
+end
+option_end()
+
+if has_config("zlib") then
+    add_requires("zlib")
+end
+
+option("avx2")
+do
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build with AVX2 (the JSON escaping kernel then scans 32 bytes at a time instead of 16)")
+end
+option_end()
+
 target("log.cc")
 do
     set_kind("shared")
@@ -12,6 +33,14 @@ do
 
     add_includedirs("./src/include/", { public = true })
 
+    if has_config("zlib") then
+        add_packages("zlib")
+        add_defines("LOG_CC_WITH_ZLIB")
+    end
+    if has_config("avx2") then
+        add_vectorexts("avx2")
+    end
+
 
     LogccHasPrint = false
 
@@ -53,3 +82,23 @@ do
     add_deps("log.cc")
     add_files("./test/**.cpp")
 end
+
+
+target("log.cc.decode")
+do
+    set_group("tool")
+    set_kind("binary")
+    set_languages("c++20")
+    add_deps("log.cc")
+    add_files("./tool/decode.cpp")
+end
+
+
+target("log.cc.bench")
+do
+    set_group("bench")
+    set_kind("binary")
+    set_languages("c++20")
+    add_deps("log.cc")
+    add_files("./bench/**.cpp")
+end